@@ -0,0 +1,176 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2010 Richard Hughes <richard@hughsie.com>
+ *
+ * Correlated color temperature using the method of:
+ *   A. R. Robertson, "Computation of Correlated Color Temperature and
+ *   Distribution Temperature", J. Opt. Soc. Am. 58, 1528-1535 (1968)
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gcm-cct.h"
+
+typedef struct {
+	gdouble		 mired;		/* 10^6 / K */
+	gdouble		 u;		/* CIE 1960 u of the locus */
+	gdouble		 v;		/* CIE 1960 v of the locus */
+	gdouble		 t;		/* slope of the isotherm */
+	gdouble		 du;		/* unit vector along the isotherm, */
+	gdouble		 dv;		/* pointing above the locus */
+} GcmCctIsotherm;
+
+#define GCM_CCT_ISOTHERM(m,u,v,t)	{ m, u, v, t, 0.0, 0.0 }
+
+/* Robertson's isotherms, the unit vectors are filled in on first use */
+static GcmCctIsotherm isotherms[] = {
+	GCM_CCT_ISOTHERM (0,	0.18006, 0.26352, -0.24341),
+	GCM_CCT_ISOTHERM (10,	0.18066, 0.26589, -0.25479),
+	GCM_CCT_ISOTHERM (20,	0.18133, 0.26846, -0.26876),
+	GCM_CCT_ISOTHERM (30,	0.18208, 0.27119, -0.28539),
+	GCM_CCT_ISOTHERM (40,	0.18293, 0.27407, -0.30470),
+	GCM_CCT_ISOTHERM (50,	0.18388, 0.27709, -0.32675),
+	GCM_CCT_ISOTHERM (60,	0.18494, 0.28021, -0.35156),
+	GCM_CCT_ISOTHERM (70,	0.18611, 0.28342, -0.37915),
+	GCM_CCT_ISOTHERM (80,	0.18740, 0.28668, -0.40955),
+	GCM_CCT_ISOTHERM (90,	0.18880, 0.28997, -0.44278),
+	GCM_CCT_ISOTHERM (100,	0.19032, 0.29326, -0.47888),
+	GCM_CCT_ISOTHERM (125,	0.19462, 0.30141, -0.58204),
+	GCM_CCT_ISOTHERM (150,	0.19962, 0.30921, -0.70471),
+	GCM_CCT_ISOTHERM (175,	0.20525, 0.31647, -0.84901),
+	GCM_CCT_ISOTHERM (200,	0.21142, 0.32312, -1.0182),
+	GCM_CCT_ISOTHERM (225,	0.21807, 0.32909, -1.2168),
+	GCM_CCT_ISOTHERM (250,	0.22511, 0.33439, -1.4512),
+	GCM_CCT_ISOTHERM (275,	0.23247, 0.33904, -1.7298),
+	GCM_CCT_ISOTHERM (300,	0.24010, 0.34308, -2.0637),
+	GCM_CCT_ISOTHERM (325,	0.24792, 0.34655, -2.4681),
+	GCM_CCT_ISOTHERM (350,	0.25591, 0.34951, -2.9641),
+	GCM_CCT_ISOTHERM (375,	0.26400, 0.35200, -3.5814),
+	GCM_CCT_ISOTHERM (400,	0.27218, 0.35407, -4.3633),
+	GCM_CCT_ISOTHERM (425,	0.28039, 0.35577, -5.3762),
+	GCM_CCT_ISOTHERM (450,	0.28863, 0.35714, -6.7262),
+	GCM_CCT_ISOTHERM (475,	0.29685, 0.35823, -8.5955),
+	GCM_CCT_ISOTHERM (500,	0.30505, 0.35907, -11.324),
+	GCM_CCT_ISOTHERM (525,	0.31320, 0.35968, -15.628),
+	GCM_CCT_ISOTHERM (550,	0.32129, 0.36011, -23.325),
+	GCM_CCT_ISOTHERM (575,	0.32931, 0.36038, -40.770),
+	GCM_CCT_ISOTHERM (600,	0.33724, 0.36051, -116.45),
+};
+
+static const GcmCctIsotherm *
+gcm_cct_get_isotherms (void)
+{
+	static gsize done = 0;
+	gdouble len;
+	guint i;
+
+	if (g_once_init_enter (&done)) {
+		for (i = 0; i < G_N_ELEMENTS (isotherms); i++) {
+			len = sqrt (1.0f + isotherms[i].t * isotherms[i].t);
+			isotherms[i].du = -1.0f / len;
+			isotherms[i].dv = -isotherms[i].t / len;
+		}
+		g_once_init_leave (&done, 1);
+	}
+	return isotherms;
+}
+
+/**
+ * gcm_cct_from_xy:
+ * @x: the CIE x coordinate
+ * @y: the CIE y coordinate
+ * @temperature: the returned correlated color temperature in K
+ *
+ * Finds the temperature of the blackbody that looks closest to the color,
+ * which only takes a few multiplications for each isotherm.
+ *
+ * Return value: %FALSE if the color is outside the range of the table
+ **/
+gboolean
+gcm_cct_from_xy (gdouble x, gdouble y, gdouble *temperature)
+{
+	gdouble d;
+	gdouble dm = 0.0f;
+	gdouble div;
+	gdouble us, vs;
+	guint i;
+	const GcmCctIsotherm *iso = gcm_cct_get_isotherms ();
+
+	/* convert to CIE 1960 UCS */
+	div = -2.0f * x + 12.0f * y + 3.0f;
+	if (fabs (div) < 1e-9)
+		return FALSE;
+	us = 4.0f * x / div;
+	vs = 6.0f * y / div;
+
+	/* find the two isotherms the color is between */
+	for (i = 0; i < G_N_ELEMENTS (isotherms); i++) {
+		d = (us - iso[i].u) * iso[i].dv - (vs - iso[i].v) * iso[i].du;
+		if (i > 0 && (d <= 0.0f) != (dm <= 0.0f)) {
+			*temperature = 1e6 / (iso[i - 1].mired +
+					      dm / (dm - d) *
+					      (iso[i].mired - iso[i - 1].mired));
+			return TRUE;
+		}
+		dm = d;
+	}
+	return FALSE;
+}
+
+/**
+ * gcm_cct_to_xy:
+ * @temperature: the color temperature in K
+ * @duv: the distance from the blackbody locus in CIE 1960 UCS, positive
+ *   above the locus
+ * @x: the returned CIE x coordinate
+ * @y: the returned CIE y coordinate
+ *
+ * Gets a point on the isotemperature line, which is on the blackbody
+ * locus itself when @duv is zero.
+ *
+ * Return value: %FALSE if the temperature is lower than %GCM_CCT_MIN
+ **/
+gboolean
+gcm_cct_to_xy (gdouble temperature, gdouble duv, gdouble *x, gdouble *y)
+{
+	const GcmCctIsotherm *a;
+	const GcmCctIsotherm *b;
+	gdouble div;
+	gdouble du, dv, len;
+	gdouble f;
+	gdouble mired;
+	gdouble u, v;
+	guint i;
+	const GcmCctIsotherm *iso = gcm_cct_get_isotherms ();
+
+	if (temperature <= 0.0f)
+		return FALSE;
+	mired = 1e6 / temperature;
+	if (mired > iso[G_N_ELEMENTS (isotherms) - 1].mired)
+		return FALSE;
+
+	/* interpolate between the neighbouring isotherms */
+	for (i = 1; i < G_N_ELEMENTS (isotherms) - 1; i++) {
+		if (iso[i].mired >= mired)
+			break;
+	}
+	a = &iso[i - 1];
+	b = &iso[i];
+	f = (mired - a->mired) / (b->mired - a->mired);
+	u = a->u + f * (b->u - a->u);
+	v = a->v + f * (b->v - a->v);
+	du = a->du + f * (b->du - a->du);
+	dv = a->dv + f * (b->dv - a->dv);
+	len = sqrt (du * du + dv * dv);
+	u += duv * du / len;
+	v += duv * dv / len;
+
+	/* convert from CIE 1960 UCS */
+	div = 2.0f * u - 8.0f * v + 4.0f;
+	*x = 3.0f * u / div;
+	*y = 2.0f * v / div;
+	return TRUE;
+}
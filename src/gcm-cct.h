@@ -0,0 +1,20 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#define GCM_CCT_MIN		1667.0f		/* K, the end of the table */
+
+gboolean	 gcm_cct_from_xy			(gdouble		 x,
+							 gdouble		 y,
+							 gdouble		*temperature);
+gboolean	 gcm_cct_to_xy				(gdouble		 temperature,
+							 gdouble		 duv,
+							 gdouble		*x,
+							 gdouble		*y);
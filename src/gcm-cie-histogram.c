@@ -0,0 +1,356 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+#include <math.h>
+#include <string.h>
+#include <lcms2.h>
+
+#include "gcm-cie-histogram.h"
+
+struct GcmCieHistogram
+{
+	guint32			*bins;		/* y major, y = 0 first */
+	guint64			 total;
+};
+
+/**
+ * gcm_cie_histogram_new:
+ *
+ * Creates an empty histogram of chromaticities, covering CIE x and y
+ * from 0.0 to 1.0 in GCM_CIE_HISTOGRAM_SIZE bins each.
+ *
+ * Return value: a new histogram, free with gcm_cie_histogram_free()
+ **/
+GcmCieHistogram *
+gcm_cie_histogram_new (void)
+{
+	GcmCieHistogram *histogram;
+	histogram = g_new0 (GcmCieHistogram, 1);
+	histogram->bins = g_new0 (guint32, GCM_CIE_HISTOGRAM_SIZE * GCM_CIE_HISTOGRAM_SIZE);
+	return histogram;
+}
+
+/**
+ * gcm_cie_histogram_free:
+ * @histogram: a #GcmCieHistogram
+ **/
+void
+gcm_cie_histogram_free (GcmCieHistogram *histogram)
+{
+	if (histogram == NULL)
+		return;
+	g_free (histogram->bins);
+	g_free (histogram);
+}
+
+/**
+ * gcm_cie_histogram_get_bin:
+ * @histogram: a #GcmCieHistogram
+ * @x: the bin index along CIE x
+ * @y: the bin index along CIE y
+ *
+ * Return value: the number of colors in the bin
+ **/
+guint32
+gcm_cie_histogram_get_bin (GcmCieHistogram *histogram, guint x, guint y)
+{
+	g_return_val_if_fail (x < GCM_CIE_HISTOGRAM_SIZE, 0);
+	g_return_val_if_fail (y < GCM_CIE_HISTOGRAM_SIZE, 0);
+	return histogram->bins[y * GCM_CIE_HISTOGRAM_SIZE + x];
+}
+
+/**
+ * gcm_cie_histogram_get_total:
+ * @histogram: a #GcmCieHistogram
+ *
+ * Return value: the number of colors added, not counting black
+ **/
+guint64
+gcm_cie_histogram_get_total (GcmCieHistogram *histogram)
+{
+	return histogram->total;
+}
+
+/* returns FALSE for black, which has no chromaticity */
+static inline gboolean
+gcm_cie_histogram_add_one (guint32 *bins, gdouble X, gdouble Y, gdouble Z)
+{
+	gdouble sum = X + Y + Z;
+	gint bx, by;
+
+	if (sum < 1e-6)
+		return FALSE;
+	bx = (X / sum) * GCM_CIE_HISTOGRAM_SIZE;
+	by = (Y / sum) * GCM_CIE_HISTOGRAM_SIZE;
+	bx = CLAMP (bx, 0, GCM_CIE_HISTOGRAM_SIZE - 1);
+	by = CLAMP (by, 0, GCM_CIE_HISTOGRAM_SIZE - 1);
+	bins[by * GCM_CIE_HISTOGRAM_SIZE + bx]++;
+	return TRUE;
+}
+
+/**
+ * gcm_cie_histogram_add_xyz:
+ * @histogram: a #GcmCieHistogram
+ * @colors: an array of colors
+ * @n_colors: the size of @colors
+ *
+ * Adds some absolute colors to the histogram.
+ **/
+void
+gcm_cie_histogram_add_xyz (GcmCieHistogram *histogram,
+			   const CdColorXYZ *colors,
+			   guint n_colors)
+{
+	guint i;
+	for (i = 0; i < n_colors; i++) {
+		if (gcm_cie_histogram_add_one (histogram->bins,
+					       colors[i].X,
+					       colors[i].Y,
+					       colors[i].Z))
+			histogram->total++;
+	}
+}
+
+/**
+ * gcm_cie_histogram_add_named_colors:
+ * @histogram: a #GcmCieHistogram
+ * @profile: a named color #CdIcc
+ * @error: a #GError, or %NULL
+ *
+ * Adds the swatches of a named color profile to the histogram.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+gcm_cie_histogram_add_named_colors (GcmCieHistogram *histogram,
+				    CdIcc *profile,
+				    GError **error)
+{
+	CdColorSwatch *swatch;
+	GPtrArray *swatches;
+	cmsCIELab lab;
+	cmsCIEXYZ xyz;
+	guint i;
+
+	swatches = cd_icc_get_named_colors (profile);
+	if (swatches->len == 0) {
+		g_set_error_literal (error, 1, 0, "profile has no named colors");
+		g_ptr_array_unref (swatches);
+		return FALSE;
+	}
+	for (i = 0; i < swatches->len; i++) {
+		const CdColorLab *value;
+		swatch = g_ptr_array_index (swatches, i);
+		value = cd_color_swatch_get_value (swatch);
+		lab.L = value->L;
+		lab.a = value->a;
+		lab.b = value->b;
+		cmsLab2XYZ (cmsD50_XYZ (), &xyz, &lab);
+		if (gcm_cie_histogram_add_one (histogram->bins, xyz.X, xyz.Y, xyz.Z))
+			histogram->total++;
+	}
+	g_ptr_array_unref (swatches);
+	return TRUE;
+}
+
+typedef struct {
+	GcmCieHistogram		*histogram;
+	cmsHTRANSFORM		 transform;
+	const guchar		*pixels;
+	gint			 rowstride;
+	guint			 width;
+	GMutex			 mutex;
+} GcmCieHistogramHelper;
+
+static void
+gcm_cie_histogram_band_cb (guint start, guint end, gpointer user_data)
+{
+	GcmCieHistogramHelper *helper = (GcmCieHistogramHelper *) user_data;
+	GcmCieHistogram *histogram = helper->histogram;
+	guint32 *bins;
+	guint64 total = 0;
+	gfloat *xyz;
+	guint i, y;
+
+	/* bin into our own histogram so the threads never contend */
+	bins = g_new0 (guint32, GCM_CIE_HISTOGRAM_SIZE * GCM_CIE_HISTOGRAM_SIZE);
+	xyz = g_new (gfloat, helper->width * 3);
+	for (y = start; y < end; y++) {
+		cmsDoTransform (helper->transform,
+				helper->pixels + y * helper->rowstride,
+				xyz, helper->width);
+		for (i = 0; i < helper->width; i++) {
+			if (gcm_cie_histogram_add_one (bins,
+						       xyz[i * 3 + 0],
+						       xyz[i * 3 + 1],
+						       xyz[i * 3 + 2]))
+				total++;
+		}
+	}
+
+	/* merge once at the end of the band */
+	g_mutex_lock (&helper->mutex);
+	for (i = 0; i < GCM_CIE_HISTOGRAM_SIZE * GCM_CIE_HISTOGRAM_SIZE; i++)
+		histogram->bins[i] += bins[i];
+	histogram->total += total;
+	g_mutex_unlock (&helper->mutex);
+
+	g_free (xyz);
+	g_free (bins);
+}
+
+/**
+ * gcm_cie_histogram_add_pixbuf:
+ * @histogram: a #GcmCieHistogram
+ * @pixbuf: an 8 bit RGB or RGBA #GdkPixbuf
+ * @input: the profile of @pixbuf, or %NULL for sRGB
+ * @error: a #GError, or %NULL
+ *
+ * Adds every pixel of an image to the histogram, splitting the rows
+ * between all the CPUs.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+gcm_cie_histogram_add_pixbuf (GcmCieHistogram *histogram,
+			      GdkPixbuf *pixbuf,
+			      CdIcc *input,
+			      GError **error)
+{
+	GcmCieHistogramHelper helper;
+	cmsHPROFILE profile_in;
+	cmsHPROFILE profile_xyz;
+	cmsUInt32Number format;
+
+	/* check pixbuf is in format we can parse */
+	if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+	    gdk_pixbuf_get_bits_per_sample (pixbuf) != 8) {
+		g_set_error_literal (error, 1, 0, "format not supported");
+		return FALSE;
+	}
+	format = gdk_pixbuf_get_has_alpha (pixbuf) ? TYPE_RGBA_8 : TYPE_RGB_8;
+
+	/* relative to the D50 PCS, like the colorant tags colord reads the
+	 * primaries from, and like the named color swatches */
+	profile_xyz = cmsCreateXYZProfile ();
+	if (input != NULL)
+		profile_in = cd_icc_get_handle (input);
+	else
+		profile_in = cmsCreate_sRGBProfile ();
+	helper.transform = cmsCreateTransform (profile_in, format,
+					       profile_xyz, TYPE_XYZ_FLT,
+					       INTENT_RELATIVE_COLORIMETRIC,
+					       cmsFLAGS_NOCACHE);
+	if (input == NULL)
+		cmsCloseProfile (profile_in);
+	cmsCloseProfile (profile_xyz);
+	if (helper.transform == NULL) {
+		g_set_error_literal (error, 1, 0, "failed to setup transform");
+		return FALSE;
+	}
+
+	helper.histogram = histogram;
+	helper.pixels = gdk_pixbuf_get_pixels (pixbuf);
+	helper.rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	helper.width = gdk_pixbuf_get_width (pixbuf);
+	g_mutex_init (&helper.mutex);
+	gcm_cie_render_parallel (gdk_pixbuf_get_height (pixbuf), 16,
+				 gcm_cie_histogram_band_cb, &helper);
+	g_mutex_clear (&helper.mutex);
+	cmsDeleteTransform (helper.transform);
+	return TRUE;
+}
+
+/**
+ * gcm_cie_histogram_render:
+ * @histogram: a #GcmCieHistogram
+ *
+ * Renders the histogram as a heatmap, using a log scale so that sparse
+ * colors are still visible next to large flat areas. Empty bins are
+ * transparent.
+ *
+ * Return value: a new ARGB32 image surface with one pixel per bin and
+ * CIE y increasing upwards, free with cairo_surface_destroy()
+ **/
+cairo_surface_t *
+gcm_cie_histogram_render (GcmCieHistogram *histogram)
+{
+	cairo_surface_t *surface;
+	gdouble scale;
+	gdouble t;
+	guchar *data;
+	guint32 max = 0;
+	guint32 count;
+	gint stride;
+	guint i, x, y;
+
+	for (i = 0; i < GCM_CIE_HISTOGRAM_SIZE * GCM_CIE_HISTOGRAM_SIZE; i++)
+		max = MAX (max, histogram->bins[i]);
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+					      GCM_CIE_HISTOGRAM_SIZE,
+					      GCM_CIE_HISTOGRAM_SIZE);
+	if (max == 0)
+		return surface;
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	scale = 1.0 / log1p (max);
+	for (y = 0; y < GCM_CIE_HISTOGRAM_SIZE; y++) {
+		guint32 *row = (guint32 *) (data + (GCM_CIE_HISTOGRAM_SIZE - 1 - y) * stride);
+		for (x = 0; x < GCM_CIE_HISTOGRAM_SIZE; x++) {
+			guint8 r, g, b, a;
+
+			count = histogram->bins[y * GCM_CIE_HISTOGRAM_SIZE + x];
+			if (count == 0)
+				continue;
+
+			/* dark blue through red to yellow, premultiplied */
+			t = log1p (count) * scale;
+			a = 255 * (0.4 + 0.6 * t);
+			r = a * MIN (1.0, t * 2.0);
+			g = a * MAX (0.0, t * 2.0 - 1.0);
+			b = a * MAX (0.0, 0.5 - t);
+			row[x] = ((guint32) a << 24) | (r << 16) | (g << 8) | b;
+		}
+	}
+	cairo_surface_mark_dirty (surface);
+	return surface;
+}
+
+/**
+ * gcm_cie_histogram_paint:
+ * @cr: a cairo context
+ * @heatmap: a surface from gcm_cie_histogram_render()
+ * @map: the chromaticity of each pixel in user space
+ *
+ * Paints the heatmap over the diagram.
+ **/
+void
+gcm_cie_histogram_paint (cairo_t *cr,
+			 cairo_surface_t *heatmap,
+			 const GcmCieMapping *map)
+{
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	const gdouble n = GCM_CIE_HISTOGRAM_SIZE;
+
+	/* user space to heatmap pixels, which have CIE y flipped */
+	pattern = cairo_pattern_create_for_surface (heatmap);
+	cairo_matrix_init (&matrix,
+			   n * map->dcx, 0.0,
+			   0.0, -n * map->dcy,
+			   n * map->cx, n * (1.0 - map->cy));
+	cairo_pattern_set_matrix (pattern, &matrix);
+	cairo_pattern_set_filter (pattern, CAIRO_FILTER_NEAREST);
+	cairo_save (cr);
+	cairo_set_source (cr, pattern);
+	cairo_paint (cr);
+	cairo_restore (cr);
+	cairo_pattern_destroy (pattern);
+}
@@ -0,0 +1,38 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include <colord.h>
+
+#include "gcm-cie-render.h"
+
+#define GCM_CIE_HISTOGRAM_SIZE		256	/* bins along each axis */
+
+typedef struct GcmCieHistogram		GcmCieHistogram;
+
+GcmCieHistogram	*gcm_cie_histogram_new			(void);
+void		 gcm_cie_histogram_free			(GcmCieHistogram	*histogram);
+guint32		 gcm_cie_histogram_get_bin		(GcmCieHistogram	*histogram,
+							 guint			 x,
+							 guint			 y);
+guint64		 gcm_cie_histogram_get_total		(GcmCieHistogram	*histogram);
+void		 gcm_cie_histogram_add_xyz		(GcmCieHistogram	*histogram,
+							 const CdColorXYZ	*colors,
+							 guint			 n_colors);
+gboolean	 gcm_cie_histogram_add_named_colors	(GcmCieHistogram	*histogram,
+							 CdIcc			*profile,
+							 GError			**error);
+gboolean	 gcm_cie_histogram_add_pixbuf		(GcmCieHistogram	*histogram,
+							 GdkPixbuf		*pixbuf,
+							 CdIcc			*input,
+							 GError			**error);
+cairo_surface_t	*gcm_cie_histogram_render		(GcmCieHistogram	*histogram);
+void		 gcm_cie_histogram_paint		(cairo_t		*cr,
+							 cairo_surface_t	*heatmap,
+							 const GcmCieMapping	*map);
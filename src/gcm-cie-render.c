@@ -0,0 +1,1991 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * Color conversion algorithms taken from ppmcie:
+ *   Copyright (C) 1999 John Walker <kelvin@fourmilab.ch>
+ *   Copyright (C) 1999 Andrew J. S. Hamilton <Andrew.Hamilton@Colorado.EDU>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <glib/gstdio.h>
+#include <math.h>
+#include <png.h>
+
+#include "gcm-cie-render.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GCM_CIE_RENDER_HAVE_X86
+#include <immintrin.h>
+#endif
+
+#define GCM_CIE_LOCUS_FIRST	380	/* nm */
+#define GCM_CIE_LOCUS_LAST	700	/* nm, joined to the first */
+#define GCM_CIE_RENDER_STRIP_ROWS	128	/* rows held in memory for export */
+
+G_STATIC_ASSERT (GCM_CIE_HUE_TABLE_SIZE == GCM_CIE_LOCUS_LAST - GCM_CIE_LOCUS_FIRST + 1);
+
+/* The following table gives the spectral chromaticity co-ordinates
+ * for wavelengths in one nanometre increments from 380nm through 780nm */
+static const gdouble spectral_chromaticity[][2] = {
+	{ 0.1741, 0.0050 },	/* 380 nm */
+	{ 0.1741, 0.0050 },
+	{ 0.1741, 0.0050 },
+	{ 0.1741, 0.0050 },
+	{ 0.1740, 0.0050 },
+	{ 0.1740, 0.0050 },
+	{ 0.1740, 0.0050 },
+	{ 0.1739, 0.0049 },
+	{ 0.1739, 0.0049 },
+	{ 0.1738, 0.0049 },
+	{ 0.1738, 0.0049 },
+	{ 0.1738, 0.0049 },
+	{ 0.1737, 0.0049 },
+	{ 0.1737, 0.0049 },
+	{ 0.1736, 0.0049 },
+	{ 0.1736, 0.0049 },
+	{ 0.1735, 0.0049 },
+	{ 0.1735, 0.0049 },
+	{ 0.1734, 0.0048 },
+	{ 0.1734, 0.0048 },
+	{ 0.1733, 0.0048 },
+	{ 0.1733, 0.0048 },
+	{ 0.1732, 0.0048 },
+	{ 0.1732, 0.0048 },
+	{ 0.1731, 0.0048 },
+	{ 0.1730, 0.0048 },
+	{ 0.1729, 0.0048 },
+	{ 0.1728, 0.0048 },
+	{ 0.1728, 0.0048 },
+	{ 0.1727, 0.0048 },
+	{ 0.1726, 0.0048 },
+	{ 0.1725, 0.0048 },
+	{ 0.1724, 0.0048 },
+	{ 0.1723, 0.0048 },
+	{ 0.1722, 0.0048 },
+	{ 0.1721, 0.0048 },
+	{ 0.1720, 0.0049 },
+	{ 0.1719, 0.0049 },
+	{ 0.1717, 0.0049 },
+	{ 0.1716, 0.0050 },
+	{ 0.1714, 0.0051 },
+	{ 0.1712, 0.0052 },
+	{ 0.1710, 0.0053 },
+	{ 0.1708, 0.0055 },
+	{ 0.1705, 0.0056 },
+	{ 0.1703, 0.0058 },
+	{ 0.1701, 0.0060 },
+	{ 0.1698, 0.0062 },
+	{ 0.1695, 0.0064 },
+	{ 0.1692, 0.0066 },
+	{ 0.1689, 0.0069 },
+	{ 0.1685, 0.0072 },
+	{ 0.1681, 0.0075 },
+	{ 0.1677, 0.0078 },
+	{ 0.1673, 0.0082 },
+	{ 0.1669, 0.0086 },
+	{ 0.1664, 0.0090 },
+	{ 0.1660, 0.0094 },
+	{ 0.1655, 0.0099 },
+	{ 0.1650, 0.0104 },
+	{ 0.1644, 0.0109 },
+	{ 0.1638, 0.0114 },
+	{ 0.1632, 0.0119 },
+	{ 0.1626, 0.0125 },
+	{ 0.1619, 0.0131 },
+	{ 0.1611, 0.0138 },
+	{ 0.1603, 0.0145 },
+	{ 0.1595, 0.0152 },
+	{ 0.1586, 0.0160 },
+	{ 0.1576, 0.0168 },
+	{ 0.1566, 0.0177 },
+	{ 0.1556, 0.0186 },
+	{ 0.1545, 0.0196 },
+	{ 0.1534, 0.0206 },
+	{ 0.1522, 0.0216 },
+	{ 0.1510, 0.0227 },
+	{ 0.1497, 0.0240 },
+	{ 0.1483, 0.0252 },
+	{ 0.1469, 0.0266 },
+	{ 0.1455, 0.0281 },
+	{ 0.1440, 0.0297 },
+	{ 0.1424, 0.0314 },
+	{ 0.1408, 0.0332 },
+	{ 0.1391, 0.0352 },
+	{ 0.1374, 0.0374 },
+	{ 0.1355, 0.0399 },
+	{ 0.1335, 0.0427 },
+	{ 0.1314, 0.0459 },
+	{ 0.1291, 0.0494 },
+	{ 0.1267, 0.0534 },
+	{ 0.1241, 0.0578 },
+	{ 0.1215, 0.0626 },
+	{ 0.1187, 0.0678 },
+	{ 0.1158, 0.0736 },
+	{ 0.1128, 0.0799 },
+	{ 0.1096, 0.0868 },
+	{ 0.1063, 0.0945 },
+	{ 0.1028, 0.1029 },
+	{ 0.0991, 0.1120 },
+	{ 0.0953, 0.1219 },
+	{ 0.0913, 0.1327 },
+	{ 0.0871, 0.1443 },
+	{ 0.0827, 0.1569 },
+	{ 0.0781, 0.1704 },
+	{ 0.0734, 0.1850 },
+	{ 0.0687, 0.2007 },
+	{ 0.0640, 0.2175 },
+	{ 0.0593, 0.2353 },
+	{ 0.0547, 0.2541 },
+	{ 0.0500, 0.2740 },
+	{ 0.0454, 0.2950 },
+	{ 0.0408, 0.3170 },
+	{ 0.0362, 0.3399 },
+	{ 0.0318, 0.3636 },
+	{ 0.0275, 0.3879 },
+	{ 0.0235, 0.4127 },
+	{ 0.0197, 0.4378 },
+	{ 0.0163, 0.4630 },
+	{ 0.0132, 0.4882 },
+	{ 0.0105, 0.5134 },
+	{ 0.0082, 0.5384 },
+	{ 0.0063, 0.5631 },
+	{ 0.0049, 0.5871 },
+	{ 0.0040, 0.6104 },
+	{ 0.0036, 0.6330 },
+	{ 0.0039, 0.6548 },
+	{ 0.0046, 0.6759 },
+	{ 0.0060, 0.6961 },
+	{ 0.0080, 0.7153 },
+	{ 0.0106, 0.7334 },
+	{ 0.0139, 0.7502 },
+	{ 0.0178, 0.7656 },
+	{ 0.0222, 0.7796 },
+	{ 0.0273, 0.7921 },
+	{ 0.0328, 0.8029 },
+	{ 0.0389, 0.8120 },
+	{ 0.0453, 0.8194 },
+	{ 0.0522, 0.8252 },
+	{ 0.0593, 0.8294 },
+	{ 0.0667, 0.8323 },
+	{ 0.0743, 0.8338 },
+	{ 0.0821, 0.8341 },
+	{ 0.0899, 0.8333 },
+	{ 0.0979, 0.8316 },
+	{ 0.1060, 0.8292 },
+	{ 0.1142, 0.8262 },
+	{ 0.1223, 0.8228 },
+	{ 0.1305, 0.8189 },
+	{ 0.1387, 0.8148 },
+	{ 0.1468, 0.8104 },
+	{ 0.1547, 0.8059 },
+	{ 0.1625, 0.8012 },
+	{ 0.1702, 0.7965 },
+	{ 0.1778, 0.7917 },
+	{ 0.1854, 0.7867 },
+	{ 0.1929, 0.7816 },
+	{ 0.2003, 0.7764 },
+	{ 0.2077, 0.7711 },
+	{ 0.2150, 0.7656 },
+	{ 0.2223, 0.7600 },
+	{ 0.2296, 0.7543 },
+	{ 0.2369, 0.7485 },
+	{ 0.2441, 0.7426 },
+	{ 0.2514, 0.7366 },
+	{ 0.2586, 0.7305 },
+	{ 0.2658, 0.7243 },
+	{ 0.2730, 0.7181 },
+	{ 0.2801, 0.7117 },
+	{ 0.2873, 0.7053 },
+	{ 0.2945, 0.6988 },
+	{ 0.3016, 0.6923 },
+	{ 0.3088, 0.6857 },
+	{ 0.3159, 0.6791 },
+	{ 0.3231, 0.6724 },
+	{ 0.3302, 0.6656 },
+	{ 0.3374, 0.6588 },
+	{ 0.3445, 0.6520 },
+	{ 0.3517, 0.6452 },
+	{ 0.3588, 0.6383 },
+	{ 0.3660, 0.6314 },
+	{ 0.3731, 0.6245 },
+	{ 0.3802, 0.6175 },
+	{ 0.3874, 0.6105 },
+	{ 0.3945, 0.6036 },
+	{ 0.4016, 0.5966 },
+	{ 0.4087, 0.5896 },
+	{ 0.4158, 0.5826 },
+	{ 0.4229, 0.5756 },
+	{ 0.4300, 0.5686 },
+	{ 0.4370, 0.5617 },
+	{ 0.4441, 0.5547 },
+	{ 0.4511, 0.5478 },
+	{ 0.4580, 0.5408 },
+	{ 0.4650, 0.5339 },
+	{ 0.4719, 0.5271 },
+	{ 0.4788, 0.5202 },
+	{ 0.4856, 0.5134 },
+	{ 0.4924, 0.5066 },
+	{ 0.4992, 0.4999 },
+	{ 0.5058, 0.4932 },
+	{ 0.5125, 0.4866 },
+	{ 0.5191, 0.4800 },
+	{ 0.5256, 0.4735 },
+	{ 0.5321, 0.4671 },
+	{ 0.5385, 0.4607 },
+	{ 0.5448, 0.4544 },
+	{ 0.5510, 0.4482 },
+	{ 0.5572, 0.4421 },
+	{ 0.5633, 0.4361 },
+	{ 0.5693, 0.4301 },
+	{ 0.5752, 0.4242 },
+	{ 0.5810, 0.4184 },
+	{ 0.5867, 0.4128 },
+	{ 0.5922, 0.4072 },
+	{ 0.5977, 0.4018 },
+	{ 0.6029, 0.3965 },
+	{ 0.6080, 0.3914 },
+	{ 0.6130, 0.3865 },
+	{ 0.6178, 0.3817 },
+	{ 0.6225, 0.3770 },
+	{ 0.6270, 0.3725 },
+	{ 0.6315, 0.3680 },
+	{ 0.6359, 0.3637 },
+	{ 0.6402, 0.3594 },
+	{ 0.6443, 0.3553 },
+	{ 0.6482, 0.3514 },
+	{ 0.6520, 0.3476 },
+	{ 0.6557, 0.3440 },
+	{ 0.6592, 0.3406 },
+	{ 0.6625, 0.3372 },
+	{ 0.6658, 0.3340 },
+	{ 0.6689, 0.3309 },
+	{ 0.6719, 0.3279 },
+	{ 0.6747, 0.3251 },
+	{ 0.6775, 0.3224 },
+	{ 0.6801, 0.3197 },
+	{ 0.6826, 0.3172 },
+	{ 0.6850, 0.3149 },
+	{ 0.6873, 0.3126 },
+	{ 0.6894, 0.3104 },
+	{ 0.6915, 0.3083 },
+	{ 0.6935, 0.3064 },
+	{ 0.6954, 0.3045 },
+	{ 0.6972, 0.3027 },
+	{ 0.6989, 0.3010 },
+	{ 0.7006, 0.2993 },
+	{ 0.7022, 0.2977 },
+	{ 0.7037, 0.2962 },
+	{ 0.7052, 0.2948 },
+	{ 0.7066, 0.2934 },
+	{ 0.7079, 0.2920 },
+	{ 0.7092, 0.2907 },
+	{ 0.7105, 0.2895 },
+	{ 0.7117, 0.2882 },
+	{ 0.7129, 0.2871 },
+	{ 0.7140, 0.2859 },
+	{ 0.7151, 0.2848 },
+	{ 0.7162, 0.2838 },
+	{ 0.7172, 0.2828 },
+	{ 0.7181, 0.2819 },
+	{ 0.7190, 0.2809 },
+	{ 0.7199, 0.2801 },
+	{ 0.7208, 0.2792 },
+	{ 0.7216, 0.2784 },
+	{ 0.7223, 0.2777 },
+	{ 0.7230, 0.2769 },
+	{ 0.7237, 0.2763 },
+	{ 0.7243, 0.2757 },
+	{ 0.7249, 0.2751 },
+	{ 0.7255, 0.2745 },
+	{ 0.7260, 0.2740 },
+	{ 0.7265, 0.2735 },
+	{ 0.7270, 0.2730 },
+	{ 0.7274, 0.2726 },
+	{ 0.7279, 0.2721 },
+	{ 0.7283, 0.2717 },
+	{ 0.7287, 0.2713 },
+	{ 0.7290, 0.2710 },
+	{ 0.7294, 0.2706 },
+	{ 0.7297, 0.2703 },
+	{ 0.7300, 0.2700 },
+	{ 0.7302, 0.2698 },
+	{ 0.7305, 0.2695 },
+	{ 0.7307, 0.2693 },
+	{ 0.7309, 0.2691 },
+	{ 0.7311, 0.2689 },
+	{ 0.7313, 0.2687 },
+	{ 0.7315, 0.2685 },
+	{ 0.7316, 0.2684 },
+	{ 0.7318, 0.2682 },
+	{ 0.7320, 0.2680 },
+	{ 0.7322, 0.2678 },
+	{ 0.7323, 0.2677 },
+	{ 0.7324, 0.2676 },
+	{ 0.7326, 0.2674 },
+	{ 0.7327, 0.2673 },
+	{ 0.7329, 0.2671 },
+	{ 0.7330, 0.2670 },
+	{ 0.7331, 0.2669 },
+	{ 0.7333, 0.2667 },
+	{ 0.7334, 0.2666 },
+	{ 0.7336, 0.2664 },
+	{ 0.7337, 0.2663 },
+	{ 0.7338, 0.2662 },
+	{ 0.7339, 0.2661 },
+	{ 0.7340, 0.2660 },
+	{ 0.7341, 0.2659 },
+	{ 0.7342, 0.2658 },
+	{ 0.7343, 0.2657 },
+	{ 0.7343, 0.2657 },
+	{ 0.7344, 0.2656 },
+	{ 0.7344, 0.2656 },
+	{ 0.7345, 0.2655 },
+	{ 0.7345, 0.2655 },
+	{ 0.7346, 0.2654 },
+	{ 0.7346, 0.2654 },
+	{ 0.7346, 0.2654 },
+	{ 0.7346, 0.2654 },
+	{ 0.7347, 0.2653 },
+	{ 0.7347, 0.2653 },
+	{ 0.7347, 0.2653 }	/* 780 nm */
+};
+
+/**
+ * gcm_cie_color_system_init:
+ *
+ * Given an additive tricolor system CS, defined by the CIE x and y
+ * chromaticities of its three primaries (z is derived trivially as
+ * 1- (x+y)), work out the matrix that gives the contribution of each
+ * primary in a linear combination which sums to a desired chromaticity.
+ *
+ * This only depends on the primaries and the white point, so it only
+ * has to be done when one of those changes and not for every pixel.
+ **/
+void
+gcm_cie_color_system_init (GcmCieColorSystem *cs,
+			   const CdColorYxy *red,
+			   const CdColorYxy *green,
+			   const CdColorYxy *blue,
+			   const CdColorYxy *white)
+{
+	gdouble xr, yr, zr, xg, yg, zg, xb, yb, zb;
+	gdouble xw, yw, zw;
+	gdouble rx, ry, rz, gx, gy, gz, bx, by, bz;
+	gdouble rw, gw, bw;
+
+	xr = red->x; yr = red->y; zr = 1 - (xr + yr);
+	xg = green->x; yg = green->y; zg = 1 - (xg + yg);
+	xb = blue->x; yb = blue->y; zb = 1 - (xb + yb);
+
+	xw = white->x; yw = white->y; zw = 1 - (xw + yw);
+
+	/* xyz -> rgb matrix, before scaling to white-> */
+	rx = yg*zb - yb*zg; ry = xb*zg - xg*zb; rz = xg*yb - xb*yg;
+	gx = yb*zr - yr*zb; gy = xr*zb - xb*zr; gz = xb*yr - xr*yb;
+	bx = yr*zg - yg*zr; by = xg*zr - xr*zg; bz = xr*yg - xg*yr;
+
+	/* white scaling factors - dividing by yw scales the white luminance to unity */
+	rw = (rx*xw + ry*yw + rz*zw) / yw;
+	gw = (gx*xw + gy*yw + gz*zw) / yw;
+	bw = (bx*xw + by*yw + bz*zw) / yw;
+
+	/* xyz -> rgb matrix, correctly scaled to white-> */
+	cs->m[0][0] = rx / rw; cs->m[0][1] = ry / rw; cs->m[0][2] = rz / rw;
+	cs->m[1][0] = gx / gw; cs->m[1][1] = gy / gw; cs->m[1][2] = gz / gw;
+	cs->m[2][0] = bx / bw; cs->m[2][1] = by / bw; cs->m[2][2] = bz / bw;
+}
+
+/**
+ * gcm_cie_color_system_xyz_to_rgb:
+ *
+ * Given a desired chromaticity (XC, YC, ZC) in CIE space, determine the
+ * contribution of each primary. If the requested chromaticity falls
+ * outside the Maxwell triangle (color gamut) formed by the three
+ * primaries, one of the r, g, or b weights will be negative.
+ **/
+void
+gcm_cie_color_system_xyz_to_rgb (const GcmCieColorSystem *cs,
+				 gdouble xc, gdouble yc, gdouble zc,
+				 gdouble *r, gdouble *g, gdouble *b)
+{
+	*r = cs->m[0][0]*xc + cs->m[0][1]*yc + cs->m[0][2]*zc;
+	*g = cs->m[1][0]*xc + cs->m[1][1]*yc + cs->m[1][2]*zc;
+	*b = cs->m[2][0]*xc + cs->m[2][1]*yc + cs->m[2][2]*zc;
+}
+
+/**
+ * gcm_cie_color_system_constrain_rgb:
+ *
+ * If the requested RGB shade contains a negative weight for one of
+ * the primaries, it lies outside the color gamut accessible from
+ * the given triple of primaries. Desaturate it by adding white,
+ * equal quantities of R, G, and B, enough to make RGB all positive.
+ **/
+static gboolean
+gcm_cie_color_system_constrain_rgb (gdouble *r, gdouble *g, gdouble *b)
+{
+	gdouble w;
+
+	/* amount of white needed is w = - min (0, *r, *g, *b) */
+	w = (0 < *r) ? 0 : *r;
+	w = (w < *g) ? w : *g;
+	w = (w < *b) ? w : *b;
+	w = - w;
+
+	/* add just enough white to make r, g, b all positive. */
+	if (w > 0) {
+		*r += w; *g += w; *b += w;
+		return TRUE; /* color modified to fit RGB gamut */
+	}
+
+	return FALSE; /* color within RGB gamut */
+}
+
+/**
+ * gcm_cie_transfer_eval:
+ *
+ * Transform linear RGB values to nonlinear RGB values.
+ *
+ * Rec. 709 is ITU-R Recommendation BT. 709 (1990)
+ * ``Basic Parameter Values for the HDTV Standard for the Studio and for
+ * International Programme Exchange'', formerly CCIR Rec. 709.
+ *
+ * For details see
+ * http://www.inforamp.net/~poynton/ColorFAQ.html
+ * http://www.inforamp.net/~poynton/GammaFAQ.html
+ **/
+static gdouble
+gcm_cie_transfer_eval (GcmCieTransfer transfer, gdouble gamma, gdouble c)
+{
+	if (transfer == GCM_CIE_TRANSFER_REC709) {
+		/* rec. 709 gamma correction. */
+		gdouble cc = 0.018;
+		if (c < cc)
+			return c * (1.099 * pow (cc, 0.45) - 0.099) / cc;
+		return 1.099 * pow (c, 0.45) - 0.099;
+	}
+	if (transfer == GCM_CIE_TRANSFER_SRGB) {
+		/* IEC 61966-2-1 */
+		if (c <= 0.0031308)
+			return c * 12.92;
+		return 1.055 * pow (c, 1.0 / 2.4) - 0.055;
+	}
+
+	/* Nonlinear color = (Linear color)^ (1/gamma) */
+	return pow (c, 1.0 / gamma);
+}
+
+/**
+ * gcm_cie_color_system_set_transfer:
+ * @cs: the color system
+ * @transfer: a #GcmCieTransfer
+ * @gamma: the exponent, only used for %GCM_CIE_TRANSFER_GAMMA
+ *
+ * Sets the transfer function used to turn linear RGB into nonlinear RGB.
+ *
+ * The tongue only needs 8-bit output precision, so the function is
+ * tabulated once here and interpolated for each pixel rather than
+ * calling pow() three times per pixel.
+ **/
+void
+gcm_cie_color_system_set_transfer (GcmCieColorSystem *cs,
+				   GcmCieTransfer transfer,
+				   gdouble gamma)
+{
+	guint i;
+
+	for (i = 0; i <= GCM_CIE_TRANSFER_LUT_SIZE; i++) {
+		gdouble c = (gdouble) i / GCM_CIE_TRANSFER_LUT_SIZE;
+		cs->lut[i] = gcm_cie_transfer_eval (transfer, gamma, c);
+	}
+
+	/* so that the interpolation at exactly 1.0 stays in range */
+	cs->lut[GCM_CIE_TRANSFER_LUT_SIZE + 1] = cs->lut[GCM_CIE_TRANSFER_LUT_SIZE];
+}
+
+/**
+ * gcm_cie_color_system_transfer:
+ *
+ * Applies the tabulated transfer function to one value.
+ **/
+gdouble
+gcm_cie_color_system_transfer (const GcmCieColorSystem *cs, gdouble c)
+{
+	gdouble f = CLAMP (c, 0.0, 1.0) * GCM_CIE_TRANSFER_LUT_SIZE;
+	guint i = f;
+	return cs->lut[i] + (f - i) * (cs->lut[i + 1] - cs->lut[i]);
+}
+
+static guint32
+gcm_cie_color_system_pack (const GcmCieColorSystem *cs,
+			   gdouble r, gdouble g, gdouble b, gdouble mx)
+{
+	guint32 ir, ig, ib;
+
+	/* gamma correct from linear rgb to nonlinear rgb. */
+	r = gcm_cie_color_system_transfer (cs, r);
+	g = gcm_cie_color_system_transfer (cs, g);
+	b = gcm_cie_color_system_transfer (cs, b);
+
+	/* opaque, so premultiplied ARGB32 is just the color */
+	ir = CLAMP (mx * r, 0.0, 1.0) * 255.0 + 0.5;
+	ig = CLAMP (mx * g, 0.0, 1.0) * 255.0 + 0.5;
+	ib = CLAMP (mx * b, 0.0, 1.0) * 255.0 + 0.5;
+	return 0xff000000 | (ir << 16) | (ig << 8) | ib;
+}
+
+/**
+ * gcm_cie_color_system_to_pixel:
+ *
+ * Turns linear RGB weights into an opaque premultiplied ARGB32 pixel.
+ **/
+guint32
+gcm_cie_color_system_to_pixel (const GcmCieColorSystem *cs,
+			       gdouble r, gdouble g, gdouble b)
+{
+	gdouble mx = 1.0f;
+	gdouble jmax;
+
+	/* Check whether the requested color is within the
+	 * gamut achievable with the given color system. If
+	 * not, draw it in a reduced intensity, interpolated
+	 * by desaturation to the closest within-gamut color.
+	 */
+	if (gcm_cie_color_system_constrain_rgb (&r, &g, &b))
+		mx = (1.0 * 3) / 4;
+
+	/* Scale to max (rgb) = 1. */
+	jmax = MAX (r, MAX (g, b));
+	if (jmax > 0) {
+		r = r / jmax;
+		g = g / jmax;
+		b = b / jmax;
+	}
+	return gcm_cie_color_system_pack (cs, r, g, b, mx);
+}
+
+static void
+gcm_cie_render_span_scalar (const GcmCieColorSystem *cs,
+			    gdouble cx, gdouble dcx, gdouble cy,
+			    guint32 *dest, guint len)
+{
+	gdouble r, g, b;
+	gdouble dr, dg, db;
+	guint i;
+
+	gcm_cie_color_system_xyz_to_rgb (cs, cx, cy, 1.0 - (cx + cy), &r, &g, &b);
+	dr = (cs->m[0][0] - cs->m[0][2]) * dcx;
+	dg = (cs->m[1][0] - cs->m[1][2]) * dcx;
+	db = (cs->m[2][0] - cs->m[2][2]) * dcx;
+	for (i = 0; i < len; i++) {
+		dest[i] = gcm_cie_color_system_to_pixel (cs, r, g, b);
+		r += dr;
+		g += dg;
+		b += db;
+	}
+}
+
+#ifdef GCM_CIE_RENDER_HAVE_X86
+
+__attribute__((target("sse2")))
+static inline __m128
+gcm_cie_render_transfer_sse2 (const gfloat *lut, __m128 c)
+{
+	gint32 idx[4];
+	__m128 f, frac, lo, hi;
+	__m128i i;
+
+	/* SSE2 has no gather, so look the table entries up one at a time */
+	c = _mm_min_ps (_mm_max_ps (c, _mm_setzero_ps ()), _mm_set1_ps (1.f));
+	f = _mm_mul_ps (c, _mm_set1_ps (GCM_CIE_TRANSFER_LUT_SIZE));
+	i = _mm_cvttps_epi32 (f);
+	frac = _mm_sub_ps (f, _mm_cvtepi32_ps (i));
+	_mm_storeu_si128 ((__m128i *) idx, i);
+	lo = _mm_set_ps (lut[idx[3]], lut[idx[2]], lut[idx[1]], lut[idx[0]]);
+	hi = _mm_set_ps (lut[idx[3] + 1], lut[idx[2] + 1], lut[idx[1] + 1], lut[idx[0] + 1]);
+	return _mm_add_ps (lo, _mm_mul_ps (frac, _mm_sub_ps (hi, lo)));
+}
+
+/* the lanes are evaluated from the start of the span rather than by
+ * accumulating, so that single precision does not drift along a row */
+__attribute__((target("sse2")))
+static void
+gcm_cie_render_span_sse2 (const GcmCieColorSystem *cs,
+			  gdouble cx, gdouble dcx, gdouble cy,
+			  guint32 *dest, guint len)
+{
+	gdouble r0, g0, b0;
+	guint i;
+	__m128 dr, dg, db;
+	__m128 idx = _mm_set_ps (3.f, 2.f, 1.f, 0.f);
+	__m128 zero = _mm_setzero_ps ();
+	__m128 one = _mm_set1_ps (1.f);
+	__m128 desat = _mm_set1_ps (0.75f * 255.f);
+	__m128 full = _mm_set1_ps (255.f);
+	__m128 half = _mm_set1_ps (0.5f);
+	__m128i alpha = _mm_set1_epi32 (0xff000000);
+
+	gcm_cie_color_system_xyz_to_rgb (cs, cx, cy, 1.0 - (cx + cy), &r0, &g0, &b0);
+	dr = _mm_set1_ps ((cs->m[0][0] - cs->m[0][2]) * dcx);
+	dg = _mm_set1_ps ((cs->m[1][0] - cs->m[1][2]) * dcx);
+	db = _mm_set1_ps ((cs->m[2][0] - cs->m[2][2]) * dcx);
+	for (i = 0; i + 4 <= len; i += 4) {
+		__m128 r, g, b, w, mask, jmax, inv, mx;
+		__m128i ir, ig, ib;
+
+		r = _mm_add_ps (_mm_set1_ps (r0), _mm_mul_ps (idx, dr));
+		g = _mm_add_ps (_mm_set1_ps (g0), _mm_mul_ps (idx, dg));
+		b = _mm_add_ps (_mm_set1_ps (b0), _mm_mul_ps (idx, db));
+		idx = _mm_add_ps (idx, _mm_set1_ps (4.f));
+
+		/* desaturate out-of-gamut colors by adding white */
+		w = _mm_sub_ps (zero, _mm_min_ps (_mm_min_ps (r, g), b));
+		w = _mm_max_ps (w, zero);
+		mask = _mm_cmpgt_ps (w, zero);
+		mx = _mm_or_ps (_mm_and_ps (mask, desat), _mm_andnot_ps (mask, full));
+		r = _mm_add_ps (r, w);
+		g = _mm_add_ps (g, w);
+		b = _mm_add_ps (b, w);
+
+		/* scale to max (rgb) = 1 */
+		jmax = _mm_max_ps (_mm_max_ps (r, g), b);
+		mask = _mm_cmpgt_ps (jmax, zero);
+		inv = _mm_div_ps (one, jmax);
+		inv = _mm_or_ps (_mm_and_ps (mask, inv), _mm_andnot_ps (mask, one));
+
+		/* gamma correct and scale to 8 bits */
+		r = gcm_cie_render_transfer_sse2 (cs->lut, _mm_mul_ps (r, inv));
+		g = gcm_cie_render_transfer_sse2 (cs->lut, _mm_mul_ps (g, inv));
+		b = gcm_cie_render_transfer_sse2 (cs->lut, _mm_mul_ps (b, inv));
+		ir = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_min_ps (r, one), mx), half));
+		ig = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_min_ps (g, one), mx), half));
+		ib = _mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (_mm_min_ps (b, one), mx), half));
+		_mm_storeu_si128 ((__m128i *) (dest + i),
+				  _mm_or_si128 (_mm_or_si128 (alpha, _mm_slli_epi32 (ir, 16)),
+						_mm_or_si128 (_mm_slli_epi32 (ig, 8), ib)));
+	}
+
+	/* do the remainder one pixel at a time */
+	if (i < len)
+		gcm_cie_render_span_scalar (cs, cx + i * dcx, dcx, cy, dest + i, len - i);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256
+gcm_cie_render_transfer_avx2 (const gfloat *lut, __m256 c)
+{
+	__m256 f, frac, lo, hi;
+	__m256i i;
+
+	c = _mm256_min_ps (_mm256_max_ps (c, _mm256_setzero_ps ()), _mm256_set1_ps (1.f));
+	f = _mm256_mul_ps (c, _mm256_set1_ps (GCM_CIE_TRANSFER_LUT_SIZE));
+	i = _mm256_cvttps_epi32 (f);
+	frac = _mm256_sub_ps (f, _mm256_cvtepi32_ps (i));
+	lo = _mm256_i32gather_ps (lut, i, 4);
+	hi = _mm256_i32gather_ps (lut + 1, i, 4);
+	return _mm256_fmadd_ps (frac, _mm256_sub_ps (hi, lo), lo);
+}
+
+__attribute__((target("avx2,fma")))
+static void
+gcm_cie_render_span_avx2 (const GcmCieColorSystem *cs,
+			  gdouble cx, gdouble dcx, gdouble cy,
+			  guint32 *dest, guint len)
+{
+	gdouble r0, g0, b0;
+	guint i;
+	__m256 dr, dg, db;
+	__m256 idx = _mm256_set_ps (7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+	__m256 zero = _mm256_setzero_ps ();
+	__m256 one = _mm256_set1_ps (1.f);
+	__m256 desat = _mm256_set1_ps (0.75f * 255.f);
+	__m256 full = _mm256_set1_ps (255.f);
+	__m256 half = _mm256_set1_ps (0.5f);
+	__m256i alpha = _mm256_set1_epi32 (0xff000000);
+
+	gcm_cie_color_system_xyz_to_rgb (cs, cx, cy, 1.0 - (cx + cy), &r0, &g0, &b0);
+	dr = _mm256_set1_ps ((cs->m[0][0] - cs->m[0][2]) * dcx);
+	dg = _mm256_set1_ps ((cs->m[1][0] - cs->m[1][2]) * dcx);
+	db = _mm256_set1_ps ((cs->m[2][0] - cs->m[2][2]) * dcx);
+	for (i = 0; i + 8 <= len; i += 8) {
+		__m256 r, g, b, w, mask, jmax, inv, mx;
+		__m256i ir, ig, ib;
+
+		r = _mm256_fmadd_ps (idx, dr, _mm256_set1_ps (r0));
+		g = _mm256_fmadd_ps (idx, dg, _mm256_set1_ps (g0));
+		b = _mm256_fmadd_ps (idx, db, _mm256_set1_ps (b0));
+		idx = _mm256_add_ps (idx, _mm256_set1_ps (8.f));
+
+		/* desaturate out-of-gamut colors by adding white */
+		w = _mm256_sub_ps (zero, _mm256_min_ps (_mm256_min_ps (r, g), b));
+		w = _mm256_max_ps (w, zero);
+		mask = _mm256_cmp_ps (w, zero, _CMP_GT_OQ);
+		mx = _mm256_blendv_ps (full, desat, mask);
+		r = _mm256_add_ps (r, w);
+		g = _mm256_add_ps (g, w);
+		b = _mm256_add_ps (b, w);
+
+		/* scale to max (rgb) = 1 */
+		jmax = _mm256_max_ps (_mm256_max_ps (r, g), b);
+		inv = _mm256_blendv_ps (one, _mm256_div_ps (one, jmax),
+					_mm256_cmp_ps (jmax, zero, _CMP_GT_OQ));
+
+		/* gamma correct and scale to 8 bits */
+		r = gcm_cie_render_transfer_avx2 (cs->lut, _mm256_mul_ps (r, inv));
+		g = gcm_cie_render_transfer_avx2 (cs->lut, _mm256_mul_ps (g, inv));
+		b = gcm_cie_render_transfer_avx2 (cs->lut, _mm256_mul_ps (b, inv));
+		ir = _mm256_cvttps_epi32 (_mm256_fmadd_ps (_mm256_min_ps (r, one), mx, half));
+		ig = _mm256_cvttps_epi32 (_mm256_fmadd_ps (_mm256_min_ps (g, one), mx, half));
+		ib = _mm256_cvttps_epi32 (_mm256_fmadd_ps (_mm256_min_ps (b, one), mx, half));
+		_mm256_storeu_si256 ((__m256i *) (dest + i),
+				     _mm256_or_si256 (_mm256_or_si256 (alpha, _mm256_slli_epi32 (ir, 16)),
+						      _mm256_or_si256 (_mm256_slli_epi32 (ig, 8), ib)));
+	}
+
+	/* do the remainder one pixel at a time */
+	if (i < len)
+		gcm_cie_render_span_scalar (cs, cx + i * dcx, dcx, cy, dest + i, len - i);
+}
+
+#endif
+
+const gchar *
+gcm_cie_render_kernel_to_string (GcmCieRenderKernel kernel)
+{
+	if (kernel == GCM_CIE_RENDER_KERNEL_SCALAR)
+		return "scalar";
+	if (kernel == GCM_CIE_RENDER_KERNEL_SSE2)
+		return "sse2";
+	if (kernel == GCM_CIE_RENDER_KERNEL_AVX2)
+		return "avx2";
+	return NULL;
+}
+
+/**
+ * gcm_cie_render_get_span_func:
+ * @kernel: a #GcmCieRenderKernel
+ *
+ * Gets a specific span kernel, or the fastest one this CPU supports if
+ * @kernel is %GCM_CIE_RENDER_KERNEL_AUTO.
+ *
+ * Returns: the kernel, or %NULL if it is not supported on this machine
+ **/
+GcmCieRenderSpanFunc
+gcm_cie_render_get_span_func (GcmCieRenderKernel kernel)
+{
+	static gsize best = 0;
+
+	if (kernel == GCM_CIE_RENDER_KERNEL_SCALAR)
+		return gcm_cie_render_span_scalar;
+#ifdef GCM_CIE_RENDER_HAVE_X86
+	__builtin_cpu_init ();
+	if (kernel == GCM_CIE_RENDER_KERNEL_SSE2) {
+		if (!__builtin_cpu_supports ("sse2"))
+			return NULL;
+		return gcm_cie_render_span_sse2;
+	}
+	if (kernel == GCM_CIE_RENDER_KERNEL_AVX2) {
+		if (!__builtin_cpu_supports ("avx2") ||
+		    !__builtin_cpu_supports ("fma"))
+			return NULL;
+		return gcm_cie_render_span_avx2;
+	}
+#endif
+	if (kernel != GCM_CIE_RENDER_KERNEL_AUTO)
+		return NULL;
+
+	/* pick the widest one once */
+	if (g_once_init_enter (&best)) {
+		GcmCieRenderSpanFunc func = NULL;
+		for (kernel = GCM_CIE_RENDER_KERNEL_LAST - 1; func == NULL; kernel--)
+			func = gcm_cie_render_get_span_func (kernel);
+		g_debug ("using %s CIE span kernel",
+			 gcm_cie_render_kernel_to_string (kernel + 1));
+		g_once_init_leave (&best, (gsize) func);
+	}
+	return (GcmCieRenderSpanFunc) best;
+}
+
+/**
+ * gcm_cie_render_span:
+ * @cs: the color system
+ * @cx: the CIE x chromaticity of the first pixel
+ * @dcx: the CIE x increment for each pixel
+ * @cy: the CIE y chromaticity of the whole span
+ * @dest: the ARGB32 pixels to write
+ * @len: the number of pixels
+ *
+ * Renders one horizontal span of the tongue.
+ *
+ * Along a row cy is constant and cz = 1 - (cx + cy), so the linear RGB
+ * weights are affine in cx and each pixel only needs three additions
+ * rather than a full matrix multiply.
+ **/
+void
+gcm_cie_render_span (const GcmCieColorSystem *cs,
+		     gdouble cx, gdouble dcx, gdouble cy,
+		     guint32 *dest, guint len)
+{
+	GcmCieRenderSpanFunc func;
+	func = gcm_cie_render_get_span_func (GCM_CIE_RENDER_KERNEL_AUTO);
+	func (cs, cx, dcx, cy, dest, len);
+}
+
+typedef struct {
+	GcmCieRenderBandFunc	 func;
+	gpointer		 user_data;
+	GMutex			 mutex;
+	GCond			 cond;
+	guint			 pending;
+} GcmCieRenderParallel;
+
+typedef struct {
+	GcmCieRenderParallel	*helper;
+	guint			 start;
+	guint			 end;
+} GcmCieRenderBand;
+
+static void
+gcm_cie_render_band_cb (gpointer data, gpointer user_data)
+{
+	GcmCieRenderBand *band = (GcmCieRenderBand *) data;
+	GcmCieRenderParallel *helper = band->helper;
+
+	helper->func (band->start, band->end, helper->user_data);
+
+	/* wake up the caller when the last band is done */
+	g_mutex_lock (&helper->mutex);
+	if (--helper->pending == 0)
+		g_cond_signal (&helper->cond);
+	g_mutex_unlock (&helper->mutex);
+}
+
+static GThreadPool *
+gcm_cie_render_get_pool (void)
+{
+	static gsize pool = 0;
+	if (g_once_init_enter (&pool)) {
+		GThreadPool *tmp;
+		tmp = g_thread_pool_new (gcm_cie_render_band_cb, NULL,
+					 g_get_num_processors (),
+					 FALSE, NULL);
+		g_once_init_leave (&pool, (gsize) tmp);
+	}
+	return (GThreadPool *) pool;
+}
+
+/**
+ * gcm_cie_render_parallel:
+ * @n_items: the number of items, e.g. rows
+ * @min_band: the smallest number of items worth giving to a thread
+ * @func: the function to call for each band of items
+ * @user_data: data for @func
+ *
+ * Splits the items into bands and runs @func on them using a thread pool
+ * sized to the number of online CPUs, returning when all bands are done.
+ * @func must only touch the items it has been given.
+ *
+ * There are more bands than threads as the tongue is much wider in the
+ * middle rows than at the top and bottom.
+ **/
+void
+gcm_cie_render_parallel (guint n_items,
+			 guint min_band,
+			 GcmCieRenderBandFunc func,
+			 gpointer user_data)
+{
+	GcmCieRenderParallel helper;
+	g_autofree GcmCieRenderBand *bands = NULL;
+	guint band_size;
+	guint n_bands;
+	guint n_cpus = g_get_num_processors ();
+	guint i;
+
+	/* not worth the overhead */
+	if (n_cpus == 1 || n_items < min_band * 2) {
+		func (0, n_items, user_data);
+		return;
+	}
+
+	n_bands = MIN (n_cpus * 4, n_items / min_band);
+	band_size = (n_items + n_bands - 1) / n_bands;
+	n_bands = (n_items + band_size - 1) / band_size;
+	bands = g_new0 (GcmCieRenderBand, n_bands);
+
+	helper.func = func;
+	helper.user_data = user_data;
+	helper.pending = n_bands - 1;
+	g_mutex_init (&helper.mutex);
+	g_cond_init (&helper.cond);
+	for (i = 0; i < n_bands; i++) {
+		bands[i].helper = &helper;
+		bands[i].start = i * band_size;
+		bands[i].end = MIN (bands[i].start + band_size, n_items);
+	}
+
+	/* the calling thread does the first band itself */
+	for (i = 1; i < n_bands; i++)
+		g_thread_pool_push (gcm_cie_render_get_pool (), &bands[i], NULL);
+	func (bands[0].start, bands[0].end, user_data);
+
+	/* join */
+	g_mutex_lock (&helper.mutex);
+	while (helper.pending > 0)
+		g_cond_wait (&helper.cond, &helper.mutex);
+	g_mutex_unlock (&helper.mutex);
+	g_mutex_clear (&helper.mutex);
+	g_cond_clear (&helper.cond);
+}
+
+typedef struct {
+	const GcmCieColorSystem	*cs;
+	const GcmCieMapping	*map;
+	const GcmCieSpan	*spans;
+	guint			 y;
+	guchar			*data;
+	gint			 stride;
+} GcmCieRenderTongueHelper;
+
+static void
+gcm_cie_render_tongue_band_cb (guint start, guint end, gpointer user_data)
+{
+	GcmCieRenderTongueHelper *helper = (GcmCieRenderTongueHelper *) user_data;
+	const GcmCieMapping *map = helper->map;
+	guint j;
+
+	for (j = start; j < end; j++) {
+		const GcmCieSpan *span = &helper->spans[helper->y + j];
+		guint32 *row;
+
+		/* nothing inside the locus on this line */
+		if (span->max <= span->min)
+			continue;
+		row = (guint32 *) (helper->data + j * helper->stride);
+		gcm_cie_render_span (helper->cs,
+				     map->cx + span->min * map->dcx,
+				     map->dcx,
+				     map->cy + (helper->y + j) * map->dcy,
+				     row + span->min,
+				     span->max - span->min);
+	}
+}
+
+/**
+ * gcm_cie_render_tongue:
+ * @cs: the color system
+ * @map: the chromaticity of each pixel
+ * @spans: the extent of the tongue for every row of the image
+ * @y: the first row to render
+ * @n_rows: the number of rows to render
+ * @data: the ARGB32 pixels of row @y
+ * @stride: the stride of @data
+ *
+ * Fills the inside of the tongue for a range of rows, leaving the pixels
+ * outside the spans untouched. This only uses the arguments, so it is
+ * safe to call from any thread.
+ **/
+void
+gcm_cie_render_tongue (const GcmCieColorSystem *cs,
+		       const GcmCieMapping *map,
+		       const GcmCieSpan *spans,
+		       guint y,
+		       guint n_rows,
+		       guchar *data,
+		       gint stride)
+{
+	GcmCieRenderTongueHelper helper;
+
+	helper.cs = cs;
+	helper.map = map;
+	helper.spans = spans;
+	helper.y = y;
+	helper.data = data;
+	helper.stride = stride;
+	gcm_cie_render_parallel (n_rows, 32, gcm_cie_render_tongue_band_cb, &helper);
+}
+
+/**
+ * gcm_cie_render_scan_polygon:
+ * @points: the closed polygon as pairs of CIE x and y coordinates
+ * @n_points: the number of points, the last is joined to the first
+ * @map: the chromaticity of each pixel
+ * @spans: the span for each row, filled in by this function
+ * @width: the image width, used to clip the spans
+ * @height: the number of rows in @spans
+ *
+ * Converts a polygon to a span per row, using the pixel centres so that
+ * adjacent edges never leave a gap or cover the same row twice. Each span
+ * is the outermost crossing, which is exact for the convex-ish tongue.
+ **/
+void
+gcm_cie_render_scan_polygon (const gdouble *points,
+			     guint n_points,
+			     const GcmCieMapping *map,
+			     GcmCieSpan *spans,
+			     guint width,
+			     guint height)
+{
+	gdouble x0, y0, x1, y1;
+	gdouble dxdy;
+	gdouble x;
+	gint row, row_end;
+	gint tmp;
+	guint i;
+
+	for (i = 0; i < height; i++) {
+		spans[i].min = G_MAXINT;
+		spans[i].max = G_MININT;
+	}
+
+	for (i = 0; i < n_points; i++) {
+		const gdouble *p0 = &points[i * 2];
+		const gdouble *p1 = &points[((i + 1) % n_points) * 2];
+
+		/* convert the edge to display co-ordinates, top to bottom */
+		x0 = (p0[0] - map->cx) / map->dcx;
+		y0 = (p0[1] - map->cy) / map->dcy;
+		x1 = (p1[0] - map->cx) / map->dcx;
+		y1 = (p1[1] - map->cy) / map->dcy;
+		if (y0 > y1) {
+			gdouble t;
+			t = x0; x0 = x1; x1 = t;
+			t = y0; y0 = y1; y1 = t;
+		}
+
+		/* horizontal and zero length edges never cross a row centre */
+		row = ceil (y0 - 0.5);
+		row_end = ceil (y1 - 0.5);
+		if (row >= row_end)
+			continue;
+
+		/* step down the edge a row at a time */
+		dxdy = (x1 - x0) / (y1 - y0);
+		if (row < 0)
+			row = 0;
+		if (row_end > (gint) height)
+			row_end = height;
+		x = x0 + (row + 0.5 - y0) * dxdy;
+		for (; row < row_end; row++, x += dxdy) {
+			tmp = ceil (x - 0.5);
+			if (tmp < spans[row].min)
+				spans[row].min = tmp;
+			tmp = floor (x - 0.5) + 1;
+			if (tmp > spans[row].max)
+				spans[row].max = tmp;
+		}
+	}
+
+	/* clip to the image */
+	for (i = 0; i < height; i++) {
+		if (spans[i].min < 0)
+			spans[i].min = 0;
+		if (spans[i].max > (gint) width)
+			spans[i].max = width;
+		if (spans[i].max <= spans[i].min)
+			spans[i].min = spans[i].max = 0;
+	}
+}
+
+/**
+ * gcm_cie_render_get_spectral_chromaticity:
+ * @wavelength: the wavelength in nm, from 380 to 780
+ * @x: the returned CIE x coordinate
+ * @y: the returned CIE y coordinate
+ *
+ * Gets the chromaticity of a monochromatic stimulus.
+ **/
+void
+gcm_cie_render_get_spectral_chromaticity (guint wavelength, gdouble *x, gdouble *y)
+{
+	guint ix;
+
+	ix = CLAMP (wavelength, 380, 780) - 380;
+	*x = spectral_chromaticity[ix][0];
+	*y = spectral_chromaticity[ix][1];
+}
+
+/**
+ * gcm_cie_render_get_locus:
+ * @n_points: the returned number of points
+ *
+ * Gets the tongue shape, which is the spectral locus closed by the line
+ * of purples from its last point back to the first.
+ *
+ * Return value: pairs of CIE x and y coordinates
+ **/
+const gdouble *
+gcm_cie_render_get_locus (guint *n_points)
+{
+	*n_points = GCM_CIE_LOCUS_LAST - GCM_CIE_LOCUS_FIRST + 1;
+	return spectral_chromaticity[GCM_CIE_LOCUS_FIRST - 380];
+}
+
+static gdouble
+gcm_cie_hue_table_get_angle (const GcmCieHueTable *table, gdouble x, gdouble y)
+{
+	gdouble angle;
+
+	/* clockwise from the first point of the locus */
+	angle = table->angle_first - atan2 (y - table->white_y, x - table->white_x);
+	angle = fmod (angle, 2 * G_PI);
+	if (angle < 0)
+		angle += 2 * G_PI;
+	return angle;
+}
+
+/**
+ * gcm_cie_hue_table_init:
+ * @table: a #GcmCieHueTable
+ * @white: the white point
+ *
+ * Precomputes the angle of each point of the spectral locus as seen from
+ * the white point, so dominant wavelengths can be found quickly.
+ **/
+void
+gcm_cie_hue_table_init (GcmCieHueTable *table, const CdColorYxy *white)
+{
+	const gdouble *locus;
+	gdouble delta;
+	gdouble last;
+	gdouble raw = 0.0f;
+	gdouble tmp;
+	guint n_points;
+	guint i;
+
+	locus = gcm_cie_render_get_locus (&n_points);
+	table->white_x = white->x;
+	table->white_y = white->y;
+	table->angle_first = atan2 (locus[1] - white->y, locus[0] - white->x);
+	table->angle[0] = 0.0f;
+
+	/* unwrap, and keep it sorted where the blue end bunches up */
+	last = table->angle_first;
+	for (i = 1; i < n_points; i++) {
+		tmp = atan2 (locus[i * 2 + 1] - white->y, locus[i * 2] - white->x);
+		delta = last - tmp;
+		if (delta > G_PI)
+			delta -= 2 * G_PI;
+		else if (delta <= -G_PI)
+			delta += 2 * G_PI;
+		raw += delta;
+		table->angle[i] = MAX (raw, table->angle[i - 1]);
+		last = tmp;
+	}
+}
+
+static gdouble
+gcm_cie_hue_table_search (const GcmCieHueTable *table, gdouble angle)
+{
+	guint lo = 0;
+	guint hi = GCM_CIE_HUE_TABLE_SIZE - 1;
+	guint mid;
+	gdouble range;
+
+	/* find the last entry that is not after the angle */
+	if (angle >= table->angle[hi])
+		return GCM_CIE_LOCUS_LAST;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (table->angle[mid] <= angle)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	/* interpolate between the two wavelengths */
+	range = table->angle[hi] - table->angle[lo];
+	if (range <= 0.0f)
+		return GCM_CIE_LOCUS_FIRST + lo;
+	return GCM_CIE_LOCUS_FIRST + lo + (angle - table->angle[lo]) / range;
+}
+
+/**
+ * gcm_cie_hue_table_lookup:
+ * @table: a #GcmCieHueTable
+ * @x: the CIE x coordinate
+ * @y: the CIE y coordinate
+ * @wavelength: the returned wavelength in nm
+ *
+ * Finds the dominant wavelength of a color, which is where a line from the
+ * white point through the color meets the spectral locus.
+ *
+ * Return value: %FALSE for purples, where @wavelength is the complementary
+ * wavelength instead
+ **/
+gboolean
+gcm_cie_hue_table_lookup (const GcmCieHueTable *table,
+			  gdouble x, gdouble y,
+			  gdouble *wavelength)
+{
+	gdouble angle;
+
+	angle = gcm_cie_hue_table_get_angle (table, x, y);
+	if (angle <= table->angle[GCM_CIE_HUE_TABLE_SIZE - 1]) {
+		*wavelength = gcm_cie_hue_table_search (table, angle);
+		return TRUE;
+	}
+
+	/* on the line of purples, so look the other way */
+	angle -= G_PI;
+	*wavelength = gcm_cie_hue_table_search (table, angle);
+	return FALSE;
+}
+
+/**
+ * gcm_cie_render_in_gamut:
+ * @red: the red primary
+ * @green: the green primary
+ * @blue: the blue primary
+ * @x: the CIE x coordinate
+ * @y: the CIE y coordinate
+ *
+ * Gets if a chromaticity is inside the triangle of the primaries.
+ *
+ * Return value: %TRUE if the color can be shown
+ **/
+gboolean
+gcm_cie_render_in_gamut (const CdColorYxy *red,
+			 const CdColorYxy *green,
+			 const CdColorYxy *blue,
+			 gdouble x, gdouble y)
+{
+	gdouble d1, d2, d3;
+
+	/* on the same side of all three edges, whichever the winding */
+	d1 = (x - green->x) * (red->y - green->y) - (red->x - green->x) * (y - green->y);
+	d2 = (x - blue->x) * (green->y - blue->y) - (green->x - blue->x) * (y - blue->y);
+	d3 = (x - red->x) * (blue->y - red->y) - (blue->x - red->x) * (y - red->y);
+	if ((d1 < 0 || d2 < 0 || d3 < 0) && (d1 > 0 || d2 > 0 || d3 > 0))
+		return FALSE;
+	return TRUE;
+}
+
+static void
+gcm_cie_render_mesh_add_triangle (cairo_pattern_t *mesh,
+				  const gdouble *xy,
+				  const guint32 *colors,
+				  const guint *idx)
+{
+	guint k;
+
+	cairo_mesh_pattern_begin_patch (mesh);
+	cairo_mesh_pattern_move_to (mesh, xy[idx[0] * 2], xy[idx[0] * 2 + 1]);
+	cairo_mesh_pattern_line_to (mesh, xy[idx[1] * 2], xy[idx[1] * 2 + 1]);
+	cairo_mesh_pattern_line_to (mesh, xy[idx[2] * 2], xy[idx[2] * 2 + 1]);
+	for (k = 0; k < 3; k++) {
+		guint32 pixel = colors[idx[k]];
+		cairo_mesh_pattern_set_corner_color_rgb (mesh, k,
+							 ((pixel >> 16) & 0xff) / 255.0,
+							 ((pixel >> 8) & 0xff) / 255.0,
+							 (pixel & 0xff) / 255.0);
+	}
+	cairo_mesh_pattern_end_patch (mesh);
+}
+
+/**
+ * gcm_cie_render_create_mesh:
+ * @cs: the color system
+ * @steps: the number of grid cells along each axis
+ *
+ * Builds a mesh of triangles covering the tongue in CIE xy coordinates,
+ * with the colors worked out once at the vertices. It can be painted at
+ * any size, and onto vector surfaces, using gcm_cie_render_paint_mesh().
+ *
+ * Return value: a new mesh pattern, free with cairo_pattern_destroy()
+ **/
+cairo_pattern_t *
+gcm_cie_render_create_mesh (const GcmCieColorSystem *cs, guint steps)
+{
+	cairo_pattern_t *mesh;
+	gdouble r, g, b;
+	gdouble x, y;
+	gdouble *xy;
+	guint32 *colors;
+	guint n = steps + 1;
+	guint i, j;
+
+	/* the colors at each vertex of a grid over the tongue, which
+	 * fits inside x 0.0..0.75 and y 0.0..0.85 */
+	xy = g_new (gdouble, n * n * 2);
+	colors = g_new (guint32, n * n);
+	for (j = 0; j < n; j++) {
+		for (i = 0; i < n; i++) {
+			x = 0.75 * i / steps;
+			y = 0.85 * j / steps;
+			xy[(j * n + i) * 2] = x;
+			xy[(j * n + i) * 2 + 1] = y;
+			gcm_cie_color_system_xyz_to_rgb (cs, x, y, 1.0 - (x + y),
+							 &r, &g, &b);
+			colors[j * n + i] = gcm_cie_color_system_to_pixel (cs, r, g, b);
+		}
+	}
+
+	/* two triangles per cell, skipping the ones beyond x + y = 1 that
+	 * can't be inside the locus */
+	mesh = cairo_pattern_create_mesh ();
+	for (j = 0; j < steps; j++) {
+		for (i = 0; i < steps; i++) {
+			guint v = j * n + i;
+			guint lower[] = { v, v + 1, v + n + 1 };
+			guint upper[] = { v, v + n + 1, v + n };
+			if (xy[v * 2] + xy[v * 2 + 1] > 1.0)
+				continue;
+			gcm_cie_render_mesh_add_triangle (mesh, xy, colors, lower);
+			gcm_cie_render_mesh_add_triangle (mesh, xy, colors, upper);
+		}
+	}
+	g_free (xy);
+	g_free (colors);
+	return mesh;
+}
+
+/**
+ * gcm_cie_render_paint_mesh:
+ * @cr: a cairo context
+ * @mesh: a pattern from gcm_cie_render_create_mesh()
+ * @map: the chromaticity of each pixel in user space
+ *
+ * Paints the mesh clipped to the tongue.
+ **/
+void
+gcm_cie_render_paint_mesh (cairo_t *cr,
+			   cairo_pattern_t *mesh,
+			   const GcmCieMapping *map)
+{
+	cairo_matrix_t matrix;
+	const gdouble *locus;
+	guint n_points;
+	guint i;
+
+	cairo_save (cr);
+
+	/* the user space path of the tongue */
+	locus = gcm_cie_render_get_locus (&n_points);
+	for (i = 0; i < n_points; i++) {
+		cairo_line_to (cr,
+			       (locus[i * 2] - map->cx) / map->dcx,
+			       (locus[i * 2 + 1] - map->cy) / map->dcy);
+	}
+	cairo_close_path (cr);
+	cairo_clip (cr);
+
+	/* user space to CIE xy */
+	cairo_matrix_init (&matrix, map->dcx, 0.0, 0.0, map->dcy, map->cx, map->cy);
+	cairo_pattern_set_matrix (mesh, &matrix);
+	cairo_set_source (cr, mesh);
+	cairo_paint (cr);
+
+	cairo_restore (cr);
+}
+
+/**
+ * gcm_cie_render_params_init:
+ * @params: the render parameters
+ *
+ * Sets the defaults, which is CIE REC 709 with a grid and white point.
+ **/
+void
+gcm_cie_render_params_init (GcmCieRenderParams *params)
+{
+	memset (params, 0, sizeof (GcmCieRenderParams));
+	cd_color_yxy_set (&params->red, 1.0, 0.64, 0.33);
+	cd_color_yxy_set (&params->green, 1.0, 0.30, 0.60);
+	cd_color_yxy_set (&params->blue, 1.0, 0.15, 0.06);
+	cd_color_yxy_set (&params->white, 1.0, 0.3127, 0.3291);
+	params->transfer = GCM_CIE_TRANSFER_REC709;
+	params->gamma = 2.2;
+	params->engine = GCM_CIE_ENGINE_RASTER;
+	params->use_grid = TRUE;
+	params->use_whitepoint = TRUE;
+}
+
+/**
+ * gcm_cie_render_create_profile:
+ * @params: the primaries and transfer function of the diagram
+ *
+ * Creates a profile that describes the pixels of a rendered diagram, so
+ * that they can be transformed to the display.
+ *
+ * Return value: a new lcms profile, free with cmsCloseProfile()
+ **/
+cmsHPROFILE
+gcm_cie_render_create_profile (const GcmCieRenderParams *params)
+{
+	cmsCIExyY white;
+	cmsCIExyYTRIPLE primaries;
+	cmsHPROFILE profile;
+	cmsToneCurve *curve;
+	cmsToneCurve *curves[3];
+	gdouble args[5];
+
+	/* the inverse of gcm_cie_transfer_eval() */
+	if (params->transfer == GCM_CIE_TRANSFER_REC709) {
+		args[0] = 1.0 / 0.45;
+		args[1] = 1.0 / 1.099;
+		args[2] = 0.099 / 1.099;
+		args[4] = 1.099 * pow (0.018, 0.45) - 0.099;
+		args[3] = 0.018 / args[4];
+		curve = cmsBuildParametricToneCurve (NULL, 4, args);
+	} else if (params->transfer == GCM_CIE_TRANSFER_SRGB) {
+		args[0] = 2.4;
+		args[1] = 1.0 / 1.055;
+		args[2] = 0.055 / 1.055;
+		args[3] = 1.0 / 12.92;
+		args[4] = 0.04045;
+		curve = cmsBuildParametricToneCurve (NULL, 4, args);
+	} else {
+		curve = cmsBuildGamma (NULL, params->gamma);
+	}
+	curves[0] = curves[1] = curves[2] = curve;
+
+	white.x = params->white.x;
+	white.y = params->white.y;
+	white.Y = 1.0f;
+	primaries.Red.x = params->red.x;
+	primaries.Red.y = params->red.y;
+	primaries.Red.Y = 1.0f;
+	primaries.Green.x = params->green.x;
+	primaries.Green.y = params->green.y;
+	primaries.Green.Y = 1.0f;
+	primaries.Blue.x = params->blue.x;
+	primaries.Blue.y = params->blue.y;
+	primaries.Blue.Y = 1.0f;
+	profile = cmsCreateRGBProfile (&white, &primaries, curves);
+	cmsFreeToneCurve (curve);
+	return profile;
+}
+
+/**
+ * gcm_cie_render_get_mapping:
+ * @width: the diagram width
+ * @height: the diagram height
+ * @map: the returned mapping
+ *
+ * Gets the chromaticity of each pixel for a diagram of a given size, which
+ * is offset slightly so the tongue is in the middle.
+ **/
+void
+gcm_cie_render_get_mapping (guint width, guint height, GcmCieMapping *map)
+{
+	guint x_offset = width / 18.0f;
+	guint y_offset = height / 20.0f;
+
+	map->cx = -(gdouble) x_offset / (width - 1);
+	map->cy = 1.0 - (gdouble) y_offset / (height - 1);
+	map->dcx = 1.0 / (width - 1);
+	map->dcy = -1.0 / (height - 1);
+}
+
+/**
+ * gcm_cie_render_map_from_display:
+ * @map: the chromaticity of each pixel
+ * @x: the user space x coordinate
+ * @y: the user space y coordinate
+ * @cx: the returned CIE x coordinate
+ * @cy: the returned CIE y coordinate
+ *
+ * Converts a point on the diagram to a chromaticity.
+ **/
+void
+gcm_cie_render_map_from_display (const GcmCieMapping *map,
+				 gdouble x, gdouble y,
+				 gdouble *cx, gdouble *cy)
+{
+	*cx = map->cx + x * map->dcx;
+	*cy = map->cy + y * map->dcy;
+}
+
+/**
+ * gcm_cie_render_map_to_display:
+ * @map: the chromaticity of each pixel
+ * @cx: the CIE x coordinate
+ * @cy: the CIE y coordinate
+ * @x: the returned user space x coordinate
+ * @y: the returned user space y coordinate
+ *
+ * Converts a chromaticity to a point on the diagram.
+ **/
+void
+gcm_cie_render_map_to_display (const GcmCieMapping *map,
+			       gdouble cx, gdouble cy,
+			       gdouble *x, gdouble *y)
+{
+	*x = (cx - map->cx) / map->dcx;
+	*y = (cy - map->cy) / map->dcy;
+}
+
+static void
+gcm_cie_render_draw_grid (cairo_t *cr, guint width, guint height)
+{
+	guint i;
+	gdouble b;
+	gdouble dotted[] = {1., 2.};
+	gdouble divwidth  = (gdouble)width / 10.0f;
+	gdouble divheight = (gdouble)height / 10.0f;
+
+	cairo_save (cr);
+	cairo_set_line_width (cr, 1);
+	cairo_set_dash (cr, dotted, 2, 0.0);
+
+	/* do vertical lines */
+	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
+	for (i=1; i<10; i++) {
+		b = ((gdouble) i * divwidth);
+		cairo_move_to (cr, (gint)b + 0.5f, 0);
+		cairo_line_to (cr, (gint)b + 0.5f, height);
+		cairo_stroke (cr);
+	}
+
+	/* do horizontal lines */
+	for (i=1; i<10; i++) {
+		b = ((gdouble) i * divheight);
+		cairo_move_to (cr, 0, (gint)b + 0.5f);
+		cairo_line_to (cr, width, (int)b + 0.5f);
+		cairo_stroke (cr);
+	}
+
+	cairo_restore (cr);
+}
+
+/**
+ * gcm_cie_render_draw_background:
+ * @cr: a cairo context
+ * @width: the diagram width
+ * @height: the diagram height
+ * @use_grid: if the grid should be drawn
+ *
+ * Draws the white box behind the tongue.
+ **/
+void
+gcm_cie_render_draw_background (cairo_t *cr, guint width, guint height, gboolean use_grid)
+{
+	cairo_save (cr);
+
+	/* background */
+	cairo_rectangle (cr, 0, 0, width, height);
+	cairo_set_source_rgb (cr, 1, 1, 1);
+	cairo_fill (cr);
+
+	/* solid outline box */
+	cairo_rectangle (cr, 0.5f, 0.5f, width - 1, height - 1);
+	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
+	cairo_set_line_width (cr, 1);
+	cairo_stroke (cr);
+
+	cairo_restore (cr);
+
+	if (use_grid)
+		gcm_cie_render_draw_grid (cr, width, height);
+}
+
+/**
+ * gcm_cie_render_draw_locus:
+ * @cr: a cairo context
+ * @map: the chromaticity of each pixel in user space
+ *
+ * Draws the outline of the tongue.
+ **/
+void
+gcm_cie_render_draw_locus (cairo_t *cr, const GcmCieMapping *map)
+{
+	const gdouble *locus;
+	gdouble icx, icy;
+	gdouble icx_last, icy_last;
+	guint n_points;
+	guint i;
+
+	cairo_save (cr);
+	cairo_set_line_width (cr, 2.0f);
+	cairo_set_source_rgb (cr, 0.5f, 0.5f, 0.5f);
+
+	/* get first co-ordinate */
+	locus = gcm_cie_render_get_locus (&n_points);
+	gcm_cie_render_map_to_display (map, locus[0], locus[1], &icx_last, &icy_last);
+	cairo_move_to (cr, icx_last, icy_last);
+
+	for (i = 1; i < n_points; i++) {
+
+		/* get point */
+		gcm_cie_render_map_to_display (map, locus[i * 2], locus[i * 2 + 1],
+					       &icx, &icy);
+
+		/* nothing to plot */
+		if (icx == icx_last && icy == icy_last)
+			continue;
+
+		/* draw line */
+		cairo_line_to (cr, icx, icy);
+
+		icx_last = icx;
+		icy_last = icy;
+	}
+
+	/* join bottom */
+	cairo_close_path (cr);
+	cairo_stroke_preserve (cr);
+	cairo_set_line_width (cr, 1.0f);
+	cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
+	cairo_stroke (cr);
+
+	cairo_restore (cr);
+}
+
+/**
+ * gcm_cie_render_draw_gamut:
+ * @cr: a cairo context
+ * @map: the chromaticity of each pixel in user space
+ * @red: the red primary
+ * @green: the green primary
+ * @blue: the blue primary
+ *
+ * Draws the triangle of a color space.
+ **/
+void
+gcm_cie_render_draw_gamut (cairo_t *cr,
+			   const GcmCieMapping *map,
+			   const CdColorYxy *red,
+			   const CdColorYxy *green,
+			   const CdColorYxy *blue)
+{
+	gdouble wx;
+	gdouble wy;
+
+	cairo_save (cr);
+
+	cairo_set_line_width (cr, 0.9f);
+	cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
+
+	gcm_cie_render_map_to_display (map, red->x, red->y, &wx, &wy);
+	if (wx < 0 || wy < 0)
+		goto out;
+	cairo_move_to (cr, wx, wy);
+
+	gcm_cie_render_map_to_display (map, green->x, green->y, &wx, &wy);
+	if (wx < 0 || wy < 0)
+		goto out;
+	cairo_line_to (cr, wx, wy);
+
+	gcm_cie_render_map_to_display (map, blue->x, blue->y, &wx, &wy);
+	if (wx < 0 || wy < 0)
+		goto out;
+	cairo_line_to (cr, wx, wy);
+
+	cairo_close_path (cr);
+	cairo_stroke (cr);
+out:
+	cairo_restore (cr);
+}
+
+/**
+ * gcm_cie_render_draw_white_point:
+ * @cr: a cairo context
+ * @map: the chromaticity of each pixel in user space
+ * @params: the render parameters
+ * @width: the diagram width, used to size the cross
+ *
+ * Draws a cross at the white point.
+ **/
+void
+gcm_cie_render_draw_white_point (cairo_t *cr,
+				 const GcmCieMapping *map,
+				 const GcmCieRenderParams *params,
+				 guint width)
+{
+	gdouble wx;
+	gdouble wy;
+	gdouble size;
+	gdouble gap;
+
+	cairo_save (cr);
+
+	/* scale the cross according the the widget size */
+	size = width / 35.0f;
+	gap = size / 2.0f;
+
+	cairo_set_line_width (cr, 1.0f);
+
+	/* choose color of cross */
+	if (params->red.x < 0.001 && params->green.x < 0.001 && params->blue.x < 0.001)
+		cairo_set_source_rgb (cr, 1.0f, 1.0f, 1.0f);
+	else
+		cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
+
+	gcm_cie_render_map_to_display (map, params->white.x, params->white.y, &wx, &wy);
+
+	/* don't antialias the cross */
+	wx = (gint) wx + 0.5f;
+	wy = (gint) wy + 0.5f;
+
+	/* left */
+	cairo_move_to (cr, wx - gap, wy);
+	cairo_line_to (cr, wx - gap - size, wy);
+	cairo_stroke (cr);
+
+	/* right */
+	cairo_move_to (cr, wx + gap, wy);
+	cairo_line_to (cr, wx + gap + size, wy);
+	cairo_stroke (cr);
+
+	/* top */
+	cairo_move_to (cr, wx, wy - gap);
+	cairo_line_to (cr, wx, wy - gap - size);
+	cairo_stroke (cr);
+
+	/* bottom */
+	cairo_move_to (cr, wx, wy + gap);
+	cairo_line_to (cr, wx, wy + gap + size);
+	cairo_stroke (cr);
+
+	cairo_restore (cr);
+}
+
+typedef struct {
+	const GcmCieRenderParams *params;
+	GcmCieColorSystem	 cs;
+	GcmCieMapping		 map;		/* user space */
+	GcmCieMapping		 map_device;	/* device pixels */
+	GcmCieSpan		*spans;		/* for each device row */
+	cairo_pattern_t		*mesh;
+	guint			 width;
+	guint			 height;
+	gint			 scale;
+} GcmCieRenderer;
+
+static GcmCieRenderer *
+gcm_cie_renderer_new (const GcmCieRenderParams *params,
+		      guint width,
+		      guint height,
+		      gint scale)
+{
+	GcmCieRenderer *renderer;
+	const gdouble *locus;
+	guint n_points;
+
+	renderer = g_new0 (GcmCieRenderer, 1);
+	renderer->params = params;
+	renderer->width = width;
+	renderer->height = height;
+	renderer->scale = scale;
+	gcm_cie_color_system_init (&renderer->cs,
+				   &params->red, &params->green, &params->blue,
+				   &params->white);
+	gcm_cie_color_system_set_transfer (&renderer->cs,
+					   params->transfer,
+					   params->gamma);
+	gcm_cie_render_get_mapping (width, height, &renderer->map);
+
+	/* the tongue is rendered at the device resolution */
+	renderer->map_device = renderer->map;
+	renderer->map_device.dcx /= scale;
+	renderer->map_device.dcy /= scale;
+	if (params->engine == GCM_CIE_ENGINE_MESH) {
+		renderer->mesh = gcm_cie_render_create_mesh (&renderer->cs, 48);
+	} else {
+		renderer->spans = g_new (GcmCieSpan, height * scale);
+		locus = gcm_cie_render_get_locus (&n_points);
+		gcm_cie_render_scan_polygon (locus, n_points,
+					     &renderer->map_device,
+					     renderer->spans,
+					     width * scale, height * scale);
+	}
+	return renderer;
+}
+
+static void
+gcm_cie_renderer_free (GcmCieRenderer *renderer)
+{
+	if (renderer->mesh != NULL)
+		cairo_pattern_destroy (renderer->mesh);
+	g_free (renderer->spans);
+	g_free (renderer);
+}
+
+/* draws the device rows from y onwards into an image surface */
+static void
+gcm_cie_renderer_draw (GcmCieRenderer *renderer, cairo_surface_t *surface, guint y)
+{
+	const GcmCieRenderParams *params = renderer->params;
+	cairo_t *cr;
+	guint n_rows;
+
+	cr = cairo_create (surface);
+	cairo_translate (cr, 0, -(gdouble) y / renderer->scale);
+	gcm_cie_render_draw_background (cr, renderer->width, renderer->height,
+					params->use_grid);
+
+	/* the tongue */
+	if (renderer->mesh != NULL) {
+		gcm_cie_render_paint_mesh (cr, renderer->mesh, &renderer->map);
+	} else {
+		n_rows = MIN ((guint) cairo_image_surface_get_height (surface),
+			      renderer->height * renderer->scale - y);
+		cairo_surface_flush (surface);
+		gcm_cie_render_tongue (&renderer->cs, &renderer->map_device,
+				       renderer->spans, y, n_rows,
+				       cairo_image_surface_get_data (surface),
+				       cairo_image_surface_get_stride (surface));
+		cairo_surface_mark_dirty (surface);
+	}
+
+	/* overdraw lines with nice antialiasing */
+	gcm_cie_render_draw_locus (cr, &renderer->map);
+	gcm_cie_render_draw_gamut (cr, &renderer->map,
+				   &params->red, &params->green, &params->blue);
+	if (params->use_whitepoint)
+		gcm_cie_render_draw_white_point (cr, &renderer->map, params,
+						 renderer->width);
+	cairo_destroy (cr);
+}
+
+/**
+ * gcm_cie_render_to_surface:
+ * @params: the render parameters
+ * @width: the diagram width
+ * @height: the diagram height
+ * @scale: the device scale, e.g. 2 for HiDPI
+ *
+ * Renders the whole diagram without needing a widget or a display.
+ *
+ * Return value: a new image surface, free with cairo_surface_destroy()
+ **/
+cairo_surface_t *
+gcm_cie_render_to_surface (const GcmCieRenderParams *params,
+			   guint width,
+			   guint height,
+			   gint scale)
+{
+	GcmCieRenderer *renderer;
+	cairo_surface_t *surface;
+
+	g_return_val_if_fail (width > 1 && height > 1, NULL);
+	g_return_val_if_fail (scale > 0, NULL);
+
+	renderer = gcm_cie_renderer_new (params, width, height, scale);
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+					      width * scale,
+					      height * scale);
+	cairo_surface_set_device_scale (surface, scale, scale);
+	gcm_cie_renderer_draw (renderer, surface, 0);
+	gcm_cie_renderer_free (renderer);
+	return surface;
+}
+
+/* kept apart from the caller so nothing it reads after a libpng error
+ * can be clobbered by longjmp() */
+static gboolean
+gcm_cie_render_write_png (png_structp png,
+			  png_infop info,
+			  FILE *fp,
+			  GcmCieRenderer *renderer,
+			  cairo_surface_t *strip,
+			  guchar *row,
+			  guint width,
+			  guint height)
+{
+	guint i, j, y;
+
+	/* libpng errors jump back to here */
+	if (setjmp (png_jmpbuf (png)))
+		return FALSE;
+	png_init_io (png, fp);
+	png_set_IHDR (png, info, width, height, 8,
+		      PNG_COLOR_TYPE_RGB,
+		      PNG_INTERLACE_NONE,
+		      PNG_COMPRESSION_TYPE_DEFAULT,
+		      PNG_FILTER_TYPE_DEFAULT);
+	png_write_info (png, info);
+	for (y = 0; y < height; y += GCM_CIE_RENDER_STRIP_ROWS) {
+		guint n_rows = MIN (GCM_CIE_RENDER_STRIP_ROWS, height - y);
+		const guchar *data;
+		gint stride;
+
+		gcm_cie_renderer_draw (renderer, strip, y);
+		cairo_surface_flush (strip);
+		data = cairo_image_surface_get_data (strip);
+		stride = cairo_image_surface_get_stride (strip);
+
+		/* cairo uses native endian xRGB */
+		for (j = 0; j < n_rows; j++) {
+			const guint32 *src = (const guint32 *) (data + j * stride);
+			for (i = 0; i < width; i++) {
+				row[i * 3 + 0] = (src[i] >> 16) & 0xff;
+				row[i * 3 + 1] = (src[i] >> 8) & 0xff;
+				row[i * 3 + 2] = src[i] & 0xff;
+			}
+			png_write_row (png, row);
+		}
+	}
+	png_write_end (png, NULL);
+	return TRUE;
+}
+
+/**
+ * gcm_cie_render_to_png:
+ * @params: the render parameters
+ * @width: the image width
+ * @height: the image height
+ * @filename: the PNG file to write
+ * @error: a #GError, or %NULL
+ *
+ * Renders the diagram into a PNG file a strip of rows at a time, so very
+ * large images can be written without holding all the pixels in memory.
+ *
+ * Return value: %TRUE for success
+ **/
+gboolean
+gcm_cie_render_to_png (const GcmCieRenderParams *params,
+		       guint width,
+		       guint height,
+		       const gchar *filename,
+		       GError **error)
+{
+	GcmCieRenderer *renderer;
+	cairo_surface_t *strip;
+	FILE *fp;
+	gboolean ret;
+	guchar *row;
+	png_infop info = NULL;
+	png_structp png = NULL;
+
+	g_return_val_if_fail (width > 1 && height > 1, FALSE);
+
+	fp = g_fopen (filename, "wb");
+	if (fp == NULL) {
+		g_set_error (error, 1, 0, "failed to open %s: %s",
+			     filename, g_strerror (errno));
+		return FALSE;
+	}
+	png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	if (png != NULL)
+		info = png_create_info_struct (png);
+	if (info == NULL) {
+		g_set_error_literal (error, 1, 0, "failed to create PNG writer");
+		png_destroy_write_struct (&png, NULL);
+		fclose (fp);
+		return FALSE;
+	}
+
+	/* only one strip of the image is ever in memory */
+	renderer = gcm_cie_renderer_new (params, width, height, 1);
+	strip = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width,
+					    MIN (height, GCM_CIE_RENDER_STRIP_ROWS));
+	row = g_new (guchar, width * 3);
+
+	ret = gcm_cie_render_write_png (png, info, fp, renderer, strip, row,
+					width, height);
+	if (!ret)
+		g_set_error (error, 1, 0, "failed to write %s", filename);
+	png_destroy_write_struct (&png, &info);
+	if (fclose (fp) != 0 && ret) {
+		g_set_error (error, 1, 0, "failed to write %s", filename);
+		ret = FALSE;
+	}
+	g_free (row);
+	cairo_surface_destroy (strip);
+	gcm_cie_renderer_free (renderer);
+	return ret;
+}
@@ -0,0 +1,190 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <cairo.h>
+#include <colord.h>
+#include <lcms2.h>
+
+#define GCM_CIE_TRANSFER_LUT_SIZE	4096
+#define GCM_CIE_HUE_TABLE_SIZE		321	/* 380 to 700 nm */
+
+typedef enum {
+	GCM_CIE_TRANSFER_REC709,
+	GCM_CIE_TRANSFER_SRGB,
+	GCM_CIE_TRANSFER_GAMMA,
+	GCM_CIE_TRANSFER_LAST
+} GcmCieTransfer;
+
+typedef struct {
+	gdouble		 m[3][3];	/* XYZ -> linear RGB, scaled to white */
+	gfloat		 lut[GCM_CIE_TRANSFER_LUT_SIZE + 2]; /* linear -> nonlinear */
+} GcmCieColorSystem;
+
+typedef struct {
+	gdouble		 cx;		/* CIE x of the first column */
+	gdouble		 cy;		/* CIE y of the first row */
+	gdouble		 dcx;		/* CIE x increment per column */
+	gdouble		 dcy;		/* CIE y increment per row */
+} GcmCieMapping;
+
+typedef struct {
+	gint		 min;		/* first column inside the tongue */
+	gint		 max;		/* exclusive, empty if <= min */
+} GcmCieSpan;
+
+typedef struct {
+	gdouble		 white_x;
+	gdouble		 white_y;
+	gdouble		 angle_first;	/* of 380nm from the white point */
+	gdouble		 angle[GCM_CIE_HUE_TABLE_SIZE]; /* clockwise, sorted */
+} GcmCieHueTable;
+
+typedef enum {
+	GCM_CIE_ENGINE_RASTER,		/* fill every pixel */
+	GCM_CIE_ENGINE_MESH,		/* paint an interpolated mesh */
+	GCM_CIE_ENGINE_LAST
+} GcmCieEngine;
+
+typedef struct {
+	CdColorYxy		 red;
+	CdColorYxy		 green;
+	CdColorYxy		 blue;
+	CdColorYxy		 white;
+	GcmCieTransfer		 transfer;
+	gdouble			 gamma;
+	GcmCieEngine		 engine;
+	gboolean		 use_grid;
+	gboolean		 use_whitepoint;
+} GcmCieRenderParams;
+
+typedef enum {
+	GCM_CIE_RENDER_KERNEL_AUTO,
+	GCM_CIE_RENDER_KERNEL_SCALAR,
+	GCM_CIE_RENDER_KERNEL_SSE2,
+	GCM_CIE_RENDER_KERNEL_AVX2,
+	GCM_CIE_RENDER_KERNEL_LAST
+} GcmCieRenderKernel;
+
+typedef void	(*GcmCieRenderSpanFunc)			(const GcmCieColorSystem *cs,
+							 gdouble		 cx,
+							 gdouble		 dcx,
+							 gdouble		 cy,
+							 guint32		*dest,
+							 guint			 len);
+
+typedef void	(*GcmCieRenderBandFunc)			(guint			 start,
+							 guint			 end,
+							 gpointer		 user_data);
+
+void		 gcm_cie_color_system_init		(GcmCieColorSystem	*cs,
+							 const CdColorYxy	*red,
+							 const CdColorYxy	*green,
+							 const CdColorYxy	*blue,
+							 const CdColorYxy	*white);
+void		 gcm_cie_color_system_set_transfer	(GcmCieColorSystem	*cs,
+							 GcmCieTransfer		 transfer,
+							 gdouble		 gamma);
+gdouble		 gcm_cie_color_system_transfer		(const GcmCieColorSystem *cs,
+							 gdouble		 c);
+void		 gcm_cie_color_system_xyz_to_rgb	(const GcmCieColorSystem *cs,
+							 gdouble		 xc,
+							 gdouble		 yc,
+							 gdouble		 zc,
+							 gdouble		*r,
+							 gdouble		*g,
+							 gdouble		*b);
+guint32		 gcm_cie_color_system_to_pixel		(const GcmCieColorSystem *cs,
+							 gdouble		 r,
+							 gdouble		 g,
+							 gdouble		 b);
+void		 gcm_cie_render_span			(const GcmCieColorSystem *cs,
+							 gdouble		 cx,
+							 gdouble		 dcx,
+							 gdouble		 cy,
+							 guint32		*dest,
+							 guint			 len);
+const gchar	*gcm_cie_render_kernel_to_string	(GcmCieRenderKernel	 kernel);
+GcmCieRenderSpanFunc gcm_cie_render_get_span_func	(GcmCieRenderKernel	 kernel);
+void		 gcm_cie_render_parallel		(guint			 n_items,
+							 guint			 min_band,
+							 GcmCieRenderBandFunc	 func,
+							 gpointer		 user_data);
+void		 gcm_cie_render_tongue			(const GcmCieColorSystem *cs,
+							 const GcmCieMapping	*map,
+							 const GcmCieSpan	*spans,
+							 guint			 y,
+							 guint			 n_rows,
+							 guchar			*data,
+							 gint			 stride);
+void		 gcm_cie_render_scan_polygon		(const gdouble		*points,
+							 guint			 n_points,
+							 const GcmCieMapping	*map,
+							 GcmCieSpan		*spans,
+							 guint			 width,
+							 guint			 height);
+void		 gcm_cie_render_get_spectral_chromaticity (guint		 wavelength,
+							 gdouble		*x,
+							 gdouble		*y);
+const gdouble	*gcm_cie_render_get_locus		(guint			*n_points);
+void		 gcm_cie_hue_table_init			(GcmCieHueTable		*table,
+							 const CdColorYxy	*white);
+gboolean	 gcm_cie_hue_table_lookup		(const GcmCieHueTable	*table,
+							 gdouble		 x,
+							 gdouble		 y,
+							 gdouble		*wavelength);
+gboolean	 gcm_cie_render_in_gamut		(const CdColorYxy	*red,
+							 const CdColorYxy	*green,
+							 const CdColorYxy	*blue,
+							 gdouble		 x,
+							 gdouble		 y);
+cairo_pattern_t	*gcm_cie_render_create_mesh		(const GcmCieColorSystem *cs,
+							 guint			 steps);
+void		 gcm_cie_render_paint_mesh		(cairo_t		*cr,
+							 cairo_pattern_t	*mesh,
+							 const GcmCieMapping	*map);
+void		 gcm_cie_render_params_init		(GcmCieRenderParams	*params);
+cmsHPROFILE	 gcm_cie_render_create_profile		(const GcmCieRenderParams *params);
+void		 gcm_cie_render_get_mapping		(guint			 width,
+							 guint			 height,
+							 GcmCieMapping		*map);
+void		 gcm_cie_render_map_from_display	(const GcmCieMapping	*map,
+							 gdouble		 x,
+							 gdouble		 y,
+							 gdouble		*cx,
+							 gdouble		*cy);
+void		 gcm_cie_render_map_to_display		(const GcmCieMapping	*map,
+							 gdouble		 cx,
+							 gdouble		 cy,
+							 gdouble		*x,
+							 gdouble		*y);
+void		 gcm_cie_render_draw_background		(cairo_t		*cr,
+							 guint			 width,
+							 guint			 height,
+							 gboolean		 use_grid);
+void		 gcm_cie_render_draw_locus		(cairo_t		*cr,
+							 const GcmCieMapping	*map);
+void		 gcm_cie_render_draw_gamut		(cairo_t		*cr,
+							 const GcmCieMapping	*map,
+							 const CdColorYxy	*red,
+							 const CdColorYxy	*green,
+							 const CdColorYxy	*blue);
+void		 gcm_cie_render_draw_white_point	(cairo_t		*cr,
+							 const GcmCieMapping	*map,
+							 const GcmCieRenderParams *params,
+							 guint			 width);
+cairo_surface_t	*gcm_cie_render_to_surface		(const GcmCieRenderParams *params,
+							 guint			 width,
+							 guint			 height,
+							 gint			 scale);
+gboolean	 gcm_cie_render_to_png			(const GcmCieRenderParams *params,
+							 guint			 width,
+							 guint			 height,
+							 const gchar		*filename,
+							 GError			**error);
@@ -15,22 +15,55 @@
 #include <stdlib.h>
 #include <math.h>
 
+#include "gcm-cct.h"
 #include "gcm-cie-widget.h"
+#include "gcm-label-cache.h"
+#include "gcm-utils.h"
 
 G_DEFINE_TYPE (GcmCieWidget, gcm_cie_widget, GTK_TYPE_DRAWING_AREA);
 #define GCM_CIE_WIDGET_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GCM_TYPE_CIE_WIDGET, GcmCieWidgetPrivate))
 #define GCM_CIE_WIDGET_FONT "Sans 8"
+#define GCM_CIE_WIDGET_PREVIEW_FACTOR	4	/* subsampling of the preview */
+#define GCM_CIE_WIDGET_CHUNK_ROWS	64	/* rows between cancel checks */
+#define GCM_CIE_WIDGET_MESH_STEPS	48	/* grid cells along each axis */
+#define GCM_CIE_WIDGET_RESIZE_TIMEOUT	150	/* ms of a stable size */
+
+typedef enum {
+	GCM_CIE_WIDGET_DIRTY_PRIMARIES	= 1 << 0,	/* color system matrix */
+	GCM_CIE_WIDGET_DIRTY_TRANSFER	= 1 << 1,	/* color system LUT */
+	GCM_CIE_WIDGET_DIRTY_SURFACE	= 1 << 2,	/* background and grid */
+	GCM_CIE_WIDGET_DIRTY_DISPLAY	= 1 << 3,	/* display profile */
+	GCM_CIE_WIDGET_DIRTY_OVERLAYS	= 1 << 4,	/* gamuts, heatmap and white point */
+} GcmCieWidgetDirty;
 
 struct GcmCieWidgetPrivate
 {
 	gboolean		 use_grid;
 	gboolean		 use_whitepoint;
+	gboolean		 use_planckian;
+	gboolean		 async;
+	guint			 dirty;			/* GcmCieWidgetDirty */
+	GcmCieEngine		 engine;
+	cairo_pattern_t		*mesh;			/* for GCM_CIE_ENGINE_MESH */
 	guint			 chart_width;
 	guint			 chart_height;
 	PangoLayout		*layout;
-	GPtrArray		*tongue_buffer;			/* min and max of the tongue shape */
-	guint			 x_offset;
-	guint			 y_offset;
+	GcmLabelCache		*labels;		/* axis and wavelength text */
+	GcmCieSpan		*spans;			/* min and max of the tongue shape */
+	guint			 spans_size;
+	cairo_surface_t		*surface;		/* background, grid and tongue */
+	guint			 surface_width;
+	guint			 surface_height;
+	gint			 surface_scale;
+	guint			 resize_id;		/* waiting for the size to settle */
+	guint			 resize_width;
+	guint			 resize_height;
+	cairo_surface_t		*tongue;		/* full resolution tongue */
+	cairo_surface_t		*preview;		/* shown until tongue is ready */
+	guint			 tongue_width;
+	guint			 tongue_height;
+	gint			 tongue_scale;
+	GCancellable		*cancellable;		/* for the tongue being rendered */
 
 	/* CIE x and y coordinates of its three primary illuminants and the
 	 * x and y coordinates of the white point. */
@@ -38,342 +71,37 @@ struct GcmCieWidgetPrivate
 	CdColorYxy		*green;			/* green primary illuminant */
 	CdColorYxy		*blue;			/* blue primary illuminant */
 	CdColorYxy		*white;			/* white point */
-	gdouble			 gamma;			/* gamma of nonlinear correction */
-};
-
-/* The following table gives the spectral chromaticity co-ordinates
- * for wavelengths in one nanometre increments from 380nm through 780nm */
-static const gdouble spectral_chromaticity[][3] = {
-	{ 0.1741, 0.0050 },	/* 380 nm */
-	{ 0.1741, 0.0050 },
-	{ 0.1741, 0.0050 },
-	{ 0.1741, 0.0050 },
-	{ 0.1740, 0.0050 },
-	{ 0.1740, 0.0050 },
-	{ 0.1740, 0.0050 },
-	{ 0.1739, 0.0049 },
-	{ 0.1739, 0.0049 },
-	{ 0.1738, 0.0049 },
-	{ 0.1738, 0.0049 },
-	{ 0.1738, 0.0049 },
-	{ 0.1737, 0.0049 },
-	{ 0.1737, 0.0049 },
-	{ 0.1736, 0.0049 },
-	{ 0.1736, 0.0049 },
-	{ 0.1735, 0.0049 },
-	{ 0.1735, 0.0049 },
-	{ 0.1734, 0.0048 },
-	{ 0.1734, 0.0048 },
-	{ 0.1733, 0.0048 },
-	{ 0.1733, 0.0048 },
-	{ 0.1732, 0.0048 },
-	{ 0.1732, 0.0048 },
-	{ 0.1731, 0.0048 },
-	{ 0.1730, 0.0048 },
-	{ 0.1729, 0.0048 },
-	{ 0.1728, 0.0048 },
-	{ 0.1728, 0.0048 },
-	{ 0.1727, 0.0048 },
-	{ 0.1726, 0.0048 },
-	{ 0.1725, 0.0048 },
-	{ 0.1724, 0.0048 },
-	{ 0.1723, 0.0048 },
-	{ 0.1722, 0.0048 },
-	{ 0.1721, 0.0048 },
-	{ 0.1720, 0.0049 },
-	{ 0.1719, 0.0049 },
-	{ 0.1717, 0.0049 },
-	{ 0.1716, 0.0050 },
-	{ 0.1714, 0.0051 },
-	{ 0.1712, 0.0052 },
-	{ 0.1710, 0.0053 },
-	{ 0.1708, 0.0055 },
-	{ 0.1705, 0.0056 },
-	{ 0.1703, 0.0058 },
-	{ 0.1701, 0.0060 },
-	{ 0.1698, 0.0062 },
-	{ 0.1695, 0.0064 },
-	{ 0.1692, 0.0066 },
-	{ 0.1689, 0.0069 },
-	{ 0.1685, 0.0072 },
-	{ 0.1681, 0.0075 },
-	{ 0.1677, 0.0078 },
-	{ 0.1673, 0.0082 },
-	{ 0.1669, 0.0086 },
-	{ 0.1664, 0.0090 },
-	{ 0.1660, 0.0094 },
-	{ 0.1655, 0.0099 },
-	{ 0.1650, 0.0104 },
-	{ 0.1644, 0.0109 },
-	{ 0.1638, 0.0114 },
-	{ 0.1632, 0.0119 },
-	{ 0.1626, 0.0125 },
-	{ 0.1619, 0.0131 },
-	{ 0.1611, 0.0138 },
-	{ 0.1603, 0.0145 },
-	{ 0.1595, 0.0152 },
-	{ 0.1586, 0.0160 },
-	{ 0.1576, 0.0168 },
-	{ 0.1566, 0.0177 },
-	{ 0.1556, 0.0186 },
-	{ 0.1545, 0.0196 },
-	{ 0.1534, 0.0206 },
-	{ 0.1522, 0.0216 },
-	{ 0.1510, 0.0227 },
-	{ 0.1497, 0.0240 },
-	{ 0.1483, 0.0252 },
-	{ 0.1469, 0.0266 },
-	{ 0.1455, 0.0281 },
-	{ 0.1440, 0.0297 },
-	{ 0.1424, 0.0314 },
-	{ 0.1408, 0.0332 },
-	{ 0.1391, 0.0352 },
-	{ 0.1374, 0.0374 },
-	{ 0.1355, 0.0399 },
-	{ 0.1335, 0.0427 },
-	{ 0.1314, 0.0459 },
-	{ 0.1291, 0.0494 },
-	{ 0.1267, 0.0534 },
-	{ 0.1241, 0.0578 },
-	{ 0.1215, 0.0626 },
-	{ 0.1187, 0.0678 },
-	{ 0.1158, 0.0736 },
-	{ 0.1128, 0.0799 },
-	{ 0.1096, 0.0868 },
-	{ 0.1063, 0.0945 },
-	{ 0.1028, 0.1029 },
-	{ 0.0991, 0.1120 },
-	{ 0.0953, 0.1219 },
-	{ 0.0913, 0.1327 },
-	{ 0.0871, 0.1443 },
-	{ 0.0827, 0.1569 },
-	{ 0.0781, 0.1704 },
-	{ 0.0734, 0.1850 },
-	{ 0.0687, 0.2007 },
-	{ 0.0640, 0.2175 },
-	{ 0.0593, 0.2353 },
-	{ 0.0547, 0.2541 },
-	{ 0.0500, 0.2740 },
-	{ 0.0454, 0.2950 },
-	{ 0.0408, 0.3170 },
-	{ 0.0362, 0.3399 },
-	{ 0.0318, 0.3636 },
-	{ 0.0275, 0.3879 },
-	{ 0.0235, 0.4127 },
-	{ 0.0197, 0.4378 },
-	{ 0.0163, 0.4630 },
-	{ 0.0132, 0.4882 },
-	{ 0.0105, 0.5134 },
-	{ 0.0082, 0.5384 },
-	{ 0.0063, 0.5631 },
-	{ 0.0049, 0.5871 },
-	{ 0.0040, 0.6104 },
-	{ 0.0036, 0.6330 },
-	{ 0.0039, 0.6548 },
-	{ 0.0046, 0.6759 },
-	{ 0.0060, 0.6961 },
-	{ 0.0080, 0.7153 },
-	{ 0.0106, 0.7334 },
-	{ 0.0139, 0.7502 },
-	{ 0.0178, 0.7656 },
-	{ 0.0222, 0.7796 },
-	{ 0.0273, 0.7921 },
-	{ 0.0328, 0.8029 },
-	{ 0.0389, 0.8120 },
-	{ 0.0453, 0.8194 },
-	{ 0.0522, 0.8252 },
-	{ 0.0593, 0.8294 },
-	{ 0.0667, 0.8323 },
-	{ 0.0743, 0.8338 },
-	{ 0.0821, 0.8341 },
-	{ 0.0899, 0.8333 },
-	{ 0.0979, 0.8316 },
-	{ 0.1060, 0.8292 },
-	{ 0.1142, 0.8262 },
-	{ 0.1223, 0.8228 },
-	{ 0.1305, 0.8189 },
-	{ 0.1387, 0.8148 },
-	{ 0.1468, 0.8104 },
-	{ 0.1547, 0.8059 },
-	{ 0.1625, 0.8012 },
-	{ 0.1702, 0.7965 },
-	{ 0.1778, 0.7917 },
-	{ 0.1854, 0.7867 },
-	{ 0.1929, 0.7816 },
-	{ 0.2003, 0.7764 },
-	{ 0.2077, 0.7711 },
-	{ 0.2150, 0.7656 },
-	{ 0.2223, 0.7600 },
-	{ 0.2296, 0.7543 },
-	{ 0.2369, 0.7485 },
-	{ 0.2441, 0.7426 },
-	{ 0.2514, 0.7366 },
-	{ 0.2586, 0.7305 },
-	{ 0.2658, 0.7243 },
-	{ 0.2730, 0.7181 },
-	{ 0.2801, 0.7117 },
-	{ 0.2873, 0.7053 },
-	{ 0.2945, 0.6988 },
-	{ 0.3016, 0.6923 },
-	{ 0.3088, 0.6857 },
-	{ 0.3159, 0.6791 },
-	{ 0.3231, 0.6724 },
-	{ 0.3302, 0.6656 },
-	{ 0.3374, 0.6588 },
-	{ 0.3445, 0.6520 },
-	{ 0.3517, 0.6452 },
-	{ 0.3588, 0.6383 },
-	{ 0.3660, 0.6314 },
-	{ 0.3731, 0.6245 },
-	{ 0.3802, 0.6175 },
-	{ 0.3874, 0.6105 },
-	{ 0.3945, 0.6036 },
-	{ 0.4016, 0.5966 },
-	{ 0.4087, 0.5896 },
-	{ 0.4158, 0.5826 },
-	{ 0.4229, 0.5756 },
-	{ 0.4300, 0.5686 },
-	{ 0.4370, 0.5617 },
-	{ 0.4441, 0.5547 },
-	{ 0.4511, 0.5478 },
-	{ 0.4580, 0.5408 },
-	{ 0.4650, 0.5339 },
-	{ 0.4719, 0.5271 },
-	{ 0.4788, 0.5202 },
-	{ 0.4856, 0.5134 },
-	{ 0.4924, 0.5066 },
-	{ 0.4992, 0.4999 },
-	{ 0.5058, 0.4932 },
-	{ 0.5125, 0.4866 },
-	{ 0.5191, 0.4800 },
-	{ 0.5256, 0.4735 },
-	{ 0.5321, 0.4671 },
-	{ 0.5385, 0.4607 },
-	{ 0.5448, 0.4544 },
-	{ 0.5510, 0.4482 },
-	{ 0.5572, 0.4421 },
-	{ 0.5633, 0.4361 },
-	{ 0.5693, 0.4301 },
-	{ 0.5752, 0.4242 },
-	{ 0.5810, 0.4184 },
-	{ 0.5867, 0.4128 },
-	{ 0.5922, 0.4072 },
-	{ 0.5977, 0.4018 },
-	{ 0.6029, 0.3965 },
-	{ 0.6080, 0.3914 },
-	{ 0.6130, 0.3865 },
-	{ 0.6178, 0.3817 },
-	{ 0.6225, 0.3770 },
-	{ 0.6270, 0.3725 },
-	{ 0.6315, 0.3680 },
-	{ 0.6359, 0.3637 },
-	{ 0.6402, 0.3594 },
-	{ 0.6443, 0.3553 },
-	{ 0.6482, 0.3514 },
-	{ 0.6520, 0.3476 },
-	{ 0.6557, 0.3440 },
-	{ 0.6592, 0.3406 },
-	{ 0.6625, 0.3372 },
-	{ 0.6658, 0.3340 },
-	{ 0.6689, 0.3309 },
-	{ 0.6719, 0.3279 },
-	{ 0.6747, 0.3251 },
-	{ 0.6775, 0.3224 },
-	{ 0.6801, 0.3197 },
-	{ 0.6826, 0.3172 },
-	{ 0.6850, 0.3149 },
-	{ 0.6873, 0.3126 },
-	{ 0.6894, 0.3104 },
-	{ 0.6915, 0.3083 },
-	{ 0.6935, 0.3064 },
-	{ 0.6954, 0.3045 },
-	{ 0.6972, 0.3027 },
-	{ 0.6989, 0.3010 },
-	{ 0.7006, 0.2993 },
-	{ 0.7022, 0.2977 },
-	{ 0.7037, 0.2962 },
-	{ 0.7052, 0.2948 },
-	{ 0.7066, 0.2934 },
-	{ 0.7079, 0.2920 },
-	{ 0.7092, 0.2907 },
-	{ 0.7105, 0.2895 },
-	{ 0.7117, 0.2882 },
-	{ 0.7129, 0.2871 },
-	{ 0.7140, 0.2859 },
-	{ 0.7151, 0.2848 },
-	{ 0.7162, 0.2838 },
-	{ 0.7172, 0.2828 },
-	{ 0.7181, 0.2819 },
-	{ 0.7190, 0.2809 },
-	{ 0.7199, 0.2801 },
-	{ 0.7208, 0.2792 },
-	{ 0.7216, 0.2784 },
-	{ 0.7223, 0.2777 },
-	{ 0.7230, 0.2769 },
-	{ 0.7237, 0.2763 },
-	{ 0.7243, 0.2757 },
-	{ 0.7249, 0.2751 },
-	{ 0.7255, 0.2745 },
-	{ 0.7260, 0.2740 },
-	{ 0.7265, 0.2735 },
-	{ 0.7270, 0.2730 },
-	{ 0.7274, 0.2726 },
-	{ 0.7279, 0.2721 },
-	{ 0.7283, 0.2717 },
-	{ 0.7287, 0.2713 },
-	{ 0.7290, 0.2710 },
-	{ 0.7294, 0.2706 },
-	{ 0.7297, 0.2703 },
-	{ 0.7300, 0.2700 },
-	{ 0.7302, 0.2698 },
-	{ 0.7305, 0.2695 },
-	{ 0.7307, 0.2693 },
-	{ 0.7309, 0.2691 },
-	{ 0.7311, 0.2689 },
-	{ 0.7313, 0.2687 },
-	{ 0.7315, 0.2685 },
-	{ 0.7316, 0.2684 },
-	{ 0.7318, 0.2682 },
-	{ 0.7320, 0.2680 },
-	{ 0.7322, 0.2678 },
-	{ 0.7323, 0.2677 },
-	{ 0.7324, 0.2676 },
-	{ 0.7326, 0.2674 },
-	{ 0.7327, 0.2673 },
-	{ 0.7329, 0.2671 },
-	{ 0.7330, 0.2670 },
-	{ 0.7331, 0.2669 },
-	{ 0.7333, 0.2667 },
-	{ 0.7334, 0.2666 },
-	{ 0.7336, 0.2664 },
-	{ 0.7337, 0.2663 },
-	{ 0.7338, 0.2662 },
-	{ 0.7339, 0.2661 },
-	{ 0.7340, 0.2660 },
-	{ 0.7341, 0.2659 },
-	{ 0.7342, 0.2658 },
-	{ 0.7343, 0.2657 },
-	{ 0.7343, 0.2657 },
-	{ 0.7344, 0.2656 },
-	{ 0.7344, 0.2656 },
-	{ 0.7345, 0.2655 },
-	{ 0.7345, 0.2655 },
-	{ 0.7346, 0.2654 },
-	{ 0.7346, 0.2654 },
-	{ 0.7346, 0.2654 },
-	{ 0.7346, 0.2654 },
-	{ 0.7347, 0.2653 },
-	{ 0.7347, 0.2653 },
-	{ 0.7347, 0.2653 }	/* 780 nm */
+	GcmCieTransfer		 transfer;		/* nonlinear correction */
+	gdouble			 gamma;			/* for GCM_CIE_TRANSFER_GAMMA */
+	GcmCieColorSystem	 cs;			/* derived from the above */
+	GcmCieHueTable		 hue;			/* for the white point */
+	GPtrArray		*overlays;		/* of GcmCieWidgetOverlay */
+	guint			 overlay_id;		/* last one handed out */
+	cairo_surface_t		*heatmap;		/* of the histogram */
+	CdIcc			*display_profile;	/* or NULL for none */
+	cmsHTRANSFORM		 display_transform;	/* for the current primaries */
+	gboolean		 hover;			/* pointer is over the widget */
+	gdouble			 hover_x;
+	gdouble			 hover_y;
+	GdkRectangle		 readout;		/* last area of the readout */
+	PangoLayout		*readout_layout;	/* not shared with the labels */
+	gchar			*readout_text;
 };
 
 typedef struct {
-	guint		 min;
-	guint		 max;
-	gboolean	 valid;
-} GcmCieWidgetBufferItem;
+	guint			 id;
+	CdColorYxy		 red;
+	CdColorYxy		 green;
+	CdColorYxy		 blue;
+	CdColorYxy		 white;
+	GdkRGBA			 color;
+	GcmCieOverlayStyle	 style;
+} GcmCieWidgetOverlay;
 
 static gboolean gcm_cie_widget_draw (GtkWidget *cie, cairo_t *cr);
+static gboolean gcm_cie_widget_motion_notify_event (GtkWidget *widget, GdkEventMotion *event);
+static gboolean gcm_cie_widget_leave_notify_event (GtkWidget *widget, GdkEventCrossing *event);
+static void	gcm_cie_widget_style_updated (GtkWidget *widget);
 static void	gcm_cie_widget_finalize (GObject *object);
 
 enum
@@ -385,9 +113,88 @@ enum
 	PROP_GREEN,
 	PROP_BLUE,
 	PROP_WHITE,
+	PROP_TRANSFER,
+	PROP_GAMMA,
+	PROP_ASYNC,
+	PROP_ENGINE,
+	PROP_USE_PLANCKIAN,
+	PROP_DISPLAY_PROFILE,
 	PROP_LAST
 };
 
+static void
+gcm_cie_widget_invalidate (GcmCieWidget *cie)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
+
+	/* the static layers have to be rendered again on the next draw */
+	if (priv->surface != NULL) {
+		cairo_surface_destroy (priv->surface);
+		priv->surface = NULL;
+	}
+}
+
+static void
+gcm_cie_widget_invalidate_tongue (GcmCieWidget *cie)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
+
+	/* abandon any render for the old primaries or size */
+	if (priv->cancellable != NULL) {
+		g_cancellable_cancel (priv->cancellable);
+		g_clear_object (&priv->cancellable);
+	}
+	g_clear_pointer (&priv->tongue, cairo_surface_destroy);
+	g_clear_pointer (&priv->preview, cairo_surface_destroy);
+	gcm_cie_widget_invalidate (cie);
+}
+
+static void
+gcm_cie_widget_set_dirty (GcmCieWidget *cie, GcmCieWidgetDirty dirty)
+{
+	/* several changes before the next frame only cause one draw */
+	cie->priv->dirty |= dirty;
+	gtk_widget_queue_draw (GTK_WIDGET (cie));
+}
+
+static void
+gcm_cie_widget_flush_dirty (GcmCieWidget *cie)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
+
+	if (priv->dirty & GCM_CIE_WIDGET_DIRTY_PRIMARIES) {
+		gcm_cie_color_system_init (&priv->cs,
+					   priv->red, priv->green, priv->blue,
+					   priv->white);
+		gcm_cie_hue_table_init (&priv->hue, priv->white);
+	}
+	if (priv->dirty & GCM_CIE_WIDGET_DIRTY_TRANSFER)
+		gcm_cie_color_system_set_transfer (&priv->cs, priv->transfer, priv->gamma);
+
+	/* the tongue and mesh are colored using the color system */
+	if (priv->dirty & (GCM_CIE_WIDGET_DIRTY_PRIMARIES |
+			   GCM_CIE_WIDGET_DIRTY_TRANSFER)) {
+		g_clear_pointer (&priv->mesh, cairo_pattern_destroy);
+		gcm_cie_widget_invalidate_tongue (cie);
+	}
+
+	/* the transform is from the color system to the display */
+	if (priv->dirty & (GCM_CIE_WIDGET_DIRTY_PRIMARIES |
+			   GCM_CIE_WIDGET_DIRTY_TRANSFER |
+			   GCM_CIE_WIDGET_DIRTY_DISPLAY)) {
+		g_clear_pointer (&priv->display_transform, cmsDeleteTransform);
+	}
+	if (priv->dirty & (GCM_CIE_WIDGET_DIRTY_SURFACE |
+			   GCM_CIE_WIDGET_DIRTY_DISPLAY))
+		gcm_cie_widget_invalidate (cie);
+
+	/* these are only in the cached layers when converted for the display */
+	if (priv->dirty & GCM_CIE_WIDGET_DIRTY_OVERLAYS &&
+	    priv->display_profile != NULL)
+		gcm_cie_widget_invalidate (cie);
+	priv->dirty = 0;
+}
+
 static void
 gcm_cie_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -399,6 +206,24 @@ gcm_cie_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec
 	case PROP_USE_WHITEPOINT:
 		g_value_set_boolean (value, cie->priv->use_whitepoint);
 		break;
+	case PROP_TRANSFER:
+		g_value_set_uint (value, cie->priv->transfer);
+		break;
+	case PROP_GAMMA:
+		g_value_set_double (value, cie->priv->gamma);
+		break;
+	case PROP_ASYNC:
+		g_value_set_boolean (value, cie->priv->async);
+		break;
+	case PROP_ENGINE:
+		g_value_set_uint (value, cie->priv->engine);
+		break;
+	case PROP_USE_PLANCKIAN:
+		g_value_set_boolean (value, cie->priv->use_planckian);
+		break;
+	case PROP_DISPLAY_PROFILE:
+		g_value_set_object (value, cie->priv->display_profile);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -414,30 +239,55 @@ gcm_cie_set_property (GObject *object, guint prop_id, const GValue *value, GPara
 	switch (prop_id) {
 	case PROP_USE_GRID:
 		cie->priv->use_grid = g_value_get_boolean (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_SURFACE);
 		break;
 	case PROP_USE_WHITEPOINT:
 		cie->priv->use_whitepoint = g_value_get_boolean (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_OVERLAYS);
 		break;
 	case PROP_RED:
 		cd_color_yxy_copy (g_value_get_boxed (value), priv->red);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_PRIMARIES);
 		break;
 	case PROP_GREEN:
 		cd_color_yxy_copy (g_value_get_boxed (value), priv->green);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_PRIMARIES);
 		break;
 	case PROP_BLUE:
 		cd_color_yxy_copy (g_value_get_boxed (value), priv->blue);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_PRIMARIES);
 		break;
 	case PROP_WHITE:
 		cd_color_yxy_copy (g_value_get_boxed (value), priv->white);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_PRIMARIES);
+		break;
+	case PROP_TRANSFER:
+		priv->transfer = g_value_get_uint (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_TRANSFER);
+		break;
+	case PROP_GAMMA:
+		priv->gamma = g_value_get_double (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_TRANSFER);
+		break;
+	case PROP_ASYNC:
+		priv->async = g_value_get_boolean (value);
+		break;
+	case PROP_ENGINE:
+		priv->engine = g_value_get_uint (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_SURFACE);
+		break;
+	case PROP_USE_PLANCKIAN:
+		priv->use_planckian = g_value_get_boolean (value);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_SURFACE);
+		break;
+	case PROP_DISPLAY_PROFILE:
+		if (g_set_object (&priv->display_profile, g_value_get_object (value)))
+			gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_DISPLAY);
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
 	}
-
-	/* refresh widget */
-	gtk_widget_hide (GTK_WIDGET (cie));
-	gtk_widget_show (GTK_WIDGET (cie));
 }
 
 static void
@@ -447,6 +297,9 @@ gcm_cie_widget_class_init (GcmCieWidgetClass *class)
 	GObjectClass *object_class = G_OBJECT_CLASS (class);
 
 	widget_class->draw = gcm_cie_widget_draw;
+	widget_class->motion_notify_event = gcm_cie_widget_motion_notify_event;
+	widget_class->leave_notify_event = gcm_cie_widget_leave_notify_event;
+	widget_class->style_updated = gcm_cie_widget_style_updated;
 	object_class->get_property = gcm_cie_get_property;
 	object_class->set_property = gcm_cie_set_property;
 	object_class->finalize = gcm_cie_widget_finalize;
@@ -484,12 +337,47 @@ gcm_cie_widget_class_init (GcmCieWidgetClass *class)
 					 g_param_spec_boxed ("white", NULL, NULL,
 							     CD_TYPE_COLOR_YXY,
 							     G_PARAM_WRITABLE));
+	g_object_class_install_property (object_class,
+					 PROP_TRANSFER,
+					 g_param_spec_uint ("transfer", NULL, NULL,
+							    0, GCM_CIE_TRANSFER_LAST - 1,
+							    GCM_CIE_TRANSFER_REC709,
+							    G_PARAM_READWRITE));
+	g_object_class_install_property (object_class,
+					 PROP_GAMMA,
+					 g_param_spec_double ("gamma", NULL, NULL,
+							      0.1f, 10.0f, 2.2f,
+							      G_PARAM_READWRITE));
+	g_object_class_install_property (object_class,
+					 PROP_ASYNC,
+					 g_param_spec_boolean ("async", NULL, NULL,
+							       FALSE,
+							       G_PARAM_READWRITE));
+	g_object_class_install_property (object_class,
+					 PROP_ENGINE,
+					 g_param_spec_uint ("engine", NULL, NULL,
+							    0, GCM_CIE_ENGINE_LAST - 1,
+							    GCM_CIE_ENGINE_RASTER,
+							    G_PARAM_READWRITE));
+	g_object_class_install_property (object_class,
+					 PROP_USE_PLANCKIAN,
+					 g_param_spec_boolean ("use-planckian", NULL, NULL,
+							       FALSE,
+							       G_PARAM_READWRITE));
+	g_object_class_install_property (object_class,
+					 PROP_DISPLAY_PROFILE,
+					 g_param_spec_object ("display-profile", NULL, NULL,
+							      CD_TYPE_ICC,
+							      G_PARAM_READWRITE));
 }
 
-void
-gcm_cie_widget_set_from_profile (GtkWidget *widget, CdIcc *profile)
+static void
+gcm_cie_widget_get_primaries (CdIcc *profile,
+			      CdColorYxy *red_yxy,
+			      CdColorYxy *green_yxy,
+			      CdColorYxy *blue_yxy,
+			      CdColorYxy *white_yxy)
 {
-	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
 	CdColorXYZ *white;
 	CdColorXYZ *red;
 	CdColorXYZ *green;
@@ -502,20 +390,10 @@ gcm_cie_widget_set_from_profile (GtkWidget *widget, CdIcc *profile)
 		      "green", &green,
 		      "blue", &blue,
 		      NULL);
-
-	/* copy into this widget */
-	cd_color_xyz_to_yxy (white, cie->priv->white);
-	cd_color_xyz_to_yxy (red, cie->priv->red);
-	cd_color_xyz_to_yxy (green, cie->priv->green);
-	cd_color_xyz_to_yxy (blue, cie->priv->blue);
-
-	/* hide if we have no data */
-	if (cie->priv->white->x > 0.001) {
-		gtk_widget_hide (widget);
-		gtk_widget_show (widget);
-	} else {
-		gtk_widget_hide (widget);
-	}
+	cd_color_xyz_to_yxy (white, white_yxy);
+	cd_color_xyz_to_yxy (red, red_yxy);
+	cd_color_xyz_to_yxy (green, green_yxy);
+	cd_color_xyz_to_yxy (blue, blue_yxy);
 
 	/* free */
 	cd_color_xyz_free (white);
@@ -524,6 +402,124 @@ gcm_cie_widget_set_from_profile (GtkWidget *widget, CdIcc *profile)
 	cd_color_xyz_free (blue);
 }
 
+void
+gcm_cie_widget_set_from_profile (GtkWidget *widget, CdIcc *profile)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+
+	/* copy into this widget */
+	gcm_cie_widget_get_primaries (profile,
+				      cie->priv->red,
+				      cie->priv->green,
+				      cie->priv->blue,
+				      cie->priv->white);
+	gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_PRIMARIES);
+
+	/* hide if we have no data */
+	gtk_widget_set_visible (widget, cie->priv->white->x > 0.001);
+}
+
+/**
+ * gcm_cie_widget_add_overlay:
+ * @widget: a #GcmCieWidget
+ * @profile: a #CdIcc with primaries
+ * @color: the color of the outline
+ * @style: the #GcmCieOverlayStyle of the outline
+ *
+ * Adds the gamut of another profile, drawn over the diagram. The tongue
+ * does not have to be rendered again when overlays are added or removed.
+ *
+ * Return value: an ID for gcm_cie_widget_remove_overlay()
+ **/
+guint
+gcm_cie_widget_add_overlay (GtkWidget *widget,
+			    CdIcc *profile,
+			    const GdkRGBA *color,
+			    GcmCieOverlayStyle style)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+	GcmCieWidgetOverlay *overlay;
+
+	g_return_val_if_fail (CD_IS_ICC (profile), 0);
+	g_return_val_if_fail (color != NULL, 0);
+
+	overlay = g_new0 (GcmCieWidgetOverlay, 1);
+	overlay->id = ++cie->priv->overlay_id;
+	overlay->color = *color;
+	overlay->style = style;
+	gcm_cie_widget_get_primaries (profile,
+				      &overlay->red,
+				      &overlay->green,
+				      &overlay->blue,
+				      &overlay->white);
+	g_ptr_array_add (cie->priv->overlays, overlay);
+	gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_OVERLAYS);
+	return overlay->id;
+}
+
+/**
+ * gcm_cie_widget_remove_overlay:
+ * @widget: a #GcmCieWidget
+ * @id: the ID from gcm_cie_widget_add_overlay()
+ *
+ * Removes a profile gamut from the diagram.
+ *
+ * Return value: %TRUE if the overlay was found
+ **/
+gboolean
+gcm_cie_widget_remove_overlay (GtkWidget *widget, guint id)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+	GcmCieWidgetOverlay *overlay;
+	guint i;
+
+	for (i = 0; i < cie->priv->overlays->len; i++) {
+		overlay = g_ptr_array_index (cie->priv->overlays, i);
+		if (overlay->id != id)
+			continue;
+		g_ptr_array_remove_index (cie->priv->overlays, i);
+		gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_OVERLAYS);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * gcm_cie_widget_clear_overlays:
+ * @widget: a #GcmCieWidget
+ *
+ * Removes all the profile gamuts from the diagram.
+ **/
+void
+gcm_cie_widget_clear_overlays (GtkWidget *widget)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+
+	if (cie->priv->overlays->len == 0)
+		return;
+	g_ptr_array_set_size (cie->priv->overlays, 0);
+	gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_OVERLAYS);
+}
+
+/**
+ * gcm_cie_widget_set_histogram:
+ * @widget: a #GcmCieWidget
+ * @histogram: a #GcmCieHistogram, or %NULL to remove
+ *
+ * Shows where a set of colors fall on the diagram as a heatmap over the
+ * tongue. The histogram is not needed after this returns.
+ **/
+void
+gcm_cie_widget_set_histogram (GtkWidget *widget, GcmCieHistogram *histogram)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+
+	g_clear_pointer (&cie->priv->heatmap, cairo_surface_destroy);
+	if (histogram != NULL)
+		cie->priv->heatmap = gcm_cie_histogram_render (histogram);
+	gcm_cie_widget_set_dirty (cie, GCM_CIE_WIDGET_DIRTY_OVERLAYS);
+}
+
 static void
 gcm_cie_widget_init (GcmCieWidget *cie)
 {
@@ -533,7 +529,7 @@ gcm_cie_widget_init (GcmCieWidget *cie)
 	cie->priv = GCM_CIE_WIDGET_GET_PRIVATE (cie);
 	cie->priv->use_grid = TRUE;
 	cie->priv->use_whitepoint = TRUE;
-	cie->priv->tongue_buffer = g_ptr_array_new_with_free_func (g_free);
+	cie->priv->overlays = g_ptr_array_new_with_free_func (g_free);
 
 	/* default is CIE REC 709 */
 	cie->priv->red = cd_color_yxy_new ();
@@ -548,7 +544,14 @@ gcm_cie_widget_init (GcmCieWidget *cie)
 	cie->priv->blue->y = 0.06;
 	cie->priv->white->x = 0.3127;
 	cie->priv->white->y = 0.3291;
-	cie->priv->gamma = 0.0;
+	cie->priv->transfer = GCM_CIE_TRANSFER_REC709;
+	cie->priv->gamma = 2.2;
+	cie->priv->dirty = GCM_CIE_WIDGET_DIRTY_PRIMARIES |
+			   GCM_CIE_WIDGET_DIRTY_TRANSFER;
+
+	/* for the readout */
+	gtk_widget_add_events (GTK_WIDGET (cie),
+			       GDK_POINTER_MOTION_MASK | GDK_LEAVE_NOTIFY_MASK);
 
 	/* do pango stuff */
 	context =  gtk_widget_get_pango_context (GTK_WIDGET (cie));
@@ -557,7 +560,10 @@ gcm_cie_widget_init (GcmCieWidget *cie)
 	cie->priv->layout = pango_layout_new (context);
 	desc = pango_font_description_from_string (GCM_CIE_WIDGET_FONT);
 	pango_layout_set_font_description (cie->priv->layout, desc);
+	cie->priv->readout_layout = pango_layout_new (context);
+	pango_layout_set_font_description (cie->priv->readout_layout, desc);
 	pango_font_description_free (desc);
+	cie->priv->labels = gcm_label_cache_new (cie->priv->layout);
 }
 
 static void
@@ -565,510 +571,716 @@ gcm_cie_widget_finalize (GObject *object)
 {
 	GcmCieWidget *cie = (GcmCieWidget*) object;
 
+	gcm_label_cache_free (cie->priv->labels);
 	g_object_unref (cie->priv->layout);
+	g_object_unref (cie->priv->readout_layout);
+	g_free (cie->priv->readout_text);
 	cd_color_yxy_free (cie->priv->white);
 	cd_color_yxy_free (cie->priv->red);
 	cd_color_yxy_free (cie->priv->green);
 	cd_color_yxy_free (cie->priv->blue);
-	g_ptr_array_unref (cie->priv->tongue_buffer);
+	g_free (cie->priv->spans);
+	g_ptr_array_unref (cie->priv->overlays);
+	if (cie->priv->heatmap != NULL)
+		cairo_surface_destroy (cie->priv->heatmap);
+	if (cie->priv->mesh != NULL)
+		cairo_pattern_destroy (cie->priv->mesh);
+	if (cie->priv->display_transform != NULL)
+		cmsDeleteTransform (cie->priv->display_transform);
+	if (cie->priv->display_profile != NULL)
+		g_object_unref (cie->priv->display_profile);
+	if (cie->priv->resize_id != 0)
+		g_source_remove (cie->priv->resize_id);
+	gcm_cie_widget_invalidate_tongue (cie);
 	G_OBJECT_CLASS (gcm_cie_widget_parent_class)->finalize (object);
 }
 
 static void
-gcm_cie_widget_draw_grid (GcmCieWidget *cie, cairo_t *cr)
+gcm_cie_widget_get_mapping (GcmCieWidget *cie, GcmCieMapping *map)
 {
-	guint i;
-	gdouble b;
-	gdouble dotted[] = {1., 2.};
-	gdouble divwidth  = (gdouble)cie->priv->chart_width / 10.0f;
-	gdouble divheight = (gdouble)cie->priv->chart_height / 10.0f;
-
-	cairo_save (cr);
-	cairo_set_line_width (cr, 1);
-	cairo_set_dash (cr, dotted, 2, 0.0);
+	GcmCieWidgetPrivate *priv = cie->priv;
+	gcm_cie_render_get_mapping (priv->chart_width, priv->chart_height, map);
+}
 
-	/* do vertical lines */
-	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
-	for (i=1; i<10; i++) {
-		b = ((gdouble) i * divwidth);
-		cairo_move_to (cr, (gint)b + 0.5f, 0);
-		cairo_line_to (cr, (gint)b + 0.5f, cie->priv->chart_height);
-		cairo_stroke (cr);
-	}
+static void
+gcm_cie_widget_get_params (GcmCieWidget *cie, GcmCieRenderParams *params)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
 
-	/* do horizontal lines */
-	for (i=1; i<10; i++) {
-		b = ((gdouble) i * divheight);
-		cairo_move_to (cr, 0, (gint)b + 0.5f);
-		cairo_line_to (cr, cie->priv->chart_width, (int)b + 0.5f);
-		cairo_stroke (cr);
-	}
+	gcm_cie_render_params_init (params);
+	cd_color_yxy_copy (priv->red, &params->red);
+	cd_color_yxy_copy (priv->green, &params->green);
+	cd_color_yxy_copy (priv->blue, &params->blue);
+	cd_color_yxy_copy (priv->white, &params->white);
+	params->transfer = priv->transfer;
+	params->gamma = priv->gamma;
+	params->engine = priv->engine;
+	params->use_grid = priv->use_grid;
+	params->use_whitepoint = priv->use_whitepoint;
+}
 
-	cairo_restore (cr);
+static void
+gcm_cie_widget_get_device_mapping (GcmCieWidget *cie, gint scale, GcmCieMapping *map)
+{
+	/* one step for each device pixel rather than each logical one */
+	gcm_cie_widget_get_mapping (cie, map);
+	map->dcx /= scale;
+	map->dcy /= scale;
 }
 
 static void
-gcm_cie_widget_map_to_display (GcmCieWidget *cie, gdouble x, gdouble y, gdouble *x_retval, gdouble *y_retval)
+gcm_cie_widget_get_min_max_tongue (GcmCieWidget *cie, const GcmCieMapping *map)
 {
+	const gdouble *locus;
+	guint n_points;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
-	*x_retval = (x * (priv->chart_width - 1)) + priv->x_offset;
-	*y_retval = ((priv->chart_height - 1) - y * (priv->chart_height - 1)) - priv->y_offset;
+	/* only grows, so normally there is nothing to allocate */
+	if (priv->spans_size < priv->tongue_height) {
+		priv->spans = g_renew (GcmCieSpan, priv->spans, priv->tongue_height);
+		priv->spans_size = priv->tongue_height;
+	}
+
+	locus = gcm_cie_render_get_locus (&n_points);
+	gcm_cie_render_scan_polygon (locus, n_points, map, priv->spans,
+				     priv->tongue_width, priv->tongue_height);
 }
 
-static void
-gcm_cie_widget_map_from_display (GcmCieWidget *cie, gdouble x, gdouble y, gdouble *x_retval, gdouble *y_retval)
+static cairo_surface_t *
+gcm_cie_widget_render_tongue (const GcmCieColorSystem *cs,
+			      const GcmCieMapping *map,
+			      const GcmCieSpan *spans,
+			      guint width,
+			      guint height,
+			      gint scale,
+			      GCancellable *cancellable)
+{
+	cairo_surface_t *surface;
+	guchar *data;
+	gint stride;
+	guint y;
+
+	/* write the pixels directly rather than filling each one with cairo,
+	 * splitting the rows between all the CPUs */
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	for (y = 0; y < height; y += GCM_CIE_WIDGET_CHUNK_ROWS) {
+		if (g_cancellable_is_cancelled (cancellable)) {
+			cairo_surface_destroy (surface);
+			return NULL;
+		}
+		gcm_cie_render_tongue (cs, map, spans, y,
+				       MIN (GCM_CIE_WIDGET_CHUNK_ROWS, height - y),
+				       data + y * stride, stride);
+	}
+	cairo_surface_mark_dirty (surface);
+	cairo_surface_set_device_scale (surface, scale, scale);
+	return surface;
+}
+
+static cairo_surface_t *
+gcm_cie_widget_render_preview (GcmCieWidget *cie,
+			       const GcmCieMapping *map,
+			       const GcmCieSpan *spans)
 {
+	cairo_surface_t *surface;
+	GcmCieMapping preview_map;
+	GcmCieSpan *preview_spans;
+	const guint factor = GCM_CIE_WIDGET_PREVIEW_FACTOR;
+	guint width, height;
+	guint y;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
-	*x_retval = ((gdouble) x - priv->x_offset) / (priv->chart_width - 1);
-	*y_retval = 1.0 - ((gdouble) y + priv->y_offset) / (priv->chart_height - 1);
+	/* sample every nth pixel of every nth row of the real thing */
+	width = (priv->tongue_width + factor - 1) / factor;
+	height = (priv->tongue_height + factor - 1) / factor;
+	preview_spans = g_new0 (GcmCieSpan, height);
+	for (y = 0; y < height; y++) {
+		const GcmCieSpan *span = &spans[y * factor];
+		if (span->max <= span->min)
+			continue;
+		preview_spans[y].min = (span->min + factor - 1) / factor;
+		preview_spans[y].max = MIN ((span->max + factor - 1) / factor, width);
+	}
+	preview_map.cx = map->cx;
+	preview_map.cy = map->cy;
+	preview_map.dcx = map->dcx * factor;
+	preview_map.dcy = map->dcy * factor;
+	surface = gcm_cie_widget_render_tongue (&priv->cs, &preview_map,
+						preview_spans, width, height,
+						priv->tongue_scale, NULL);
+	g_free (preview_spans);
+	return surface;
 }
 
+typedef struct {
+	GcmCieColorSystem	 cs;
+	GcmCieMapping		 map;
+	GcmCieSpan		*spans;
+	guint			 width;
+	guint			 height;
+	gint			 scale;
+} GcmCieWidgetJob;
+
 static void
-gcm_cie_widget_compute_monochrome_color_location (GcmCieWidget *cie, gdouble wave_length,
-						  gdouble *x_retval, gdouble *y_retval)
+gcm_cie_widget_job_free (GcmCieWidgetJob *job)
 {
-	guint ix = wave_length - 380;
-	const gdouble px = spectral_chromaticity[ix][0];
-	const gdouble py = spectral_chromaticity[ix][1];
+	g_free (job->spans);
+	g_free (job);
+}
 
-	/* convert to screen co-ordinates */
-	gcm_cie_widget_map_to_display (cie, px, py, x_retval, y_retval);
+static void
+gcm_cie_widget_render_thread_cb (GTask *task,
+				 gpointer source_object,
+				 gpointer task_data,
+				 GCancellable *cancellable)
+{
+	GcmCieWidgetJob *job = (GcmCieWidgetJob *) task_data;
+	cairo_surface_t *surface;
+
+	/* the job is a copy, so the widget can change while we work */
+	surface = gcm_cie_widget_render_tongue (&job->cs, &job->map,
+						job->spans,
+						job->width, job->height,
+						job->scale, cancellable);
+	if (surface == NULL) {
+		g_task_return_new_error (task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_CANCELLED,
+					 "rendering was cancelled");
+		return;
+	}
+	g_task_return_pointer (task, surface,
+			       (GDestroyNotify) cairo_surface_destroy);
 }
 
 static void
-gcm_cie_widget_save_point (GcmCieWidget *cie, const guint y, const gdouble value)
+gcm_cie_widget_render_done_cb (GObject *source_object,
+			       GAsyncResult *res,
+			       gpointer user_data)
 {
-	GcmCieWidgetBufferItem *item;
+	GcmCieWidget *cie = GCM_CIE_WIDGET (source_object);
 	GcmCieWidgetPrivate *priv = cie->priv;
+	GTask *task = G_TASK (res);
+	cairo_surface_t *surface;
+	g_autoptr(GError) error = NULL;
+
+	surface = g_task_propagate_pointer (task, &error);
+	if (surface == NULL) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("failed to render tongue: %s", error->message);
+		return;
+	}
 
-	if (y >= priv->tongue_buffer->len)
+	/* superseded by newer primaries or a resize */
+	if (g_task_get_cancellable (task) != priv->cancellable) {
+		cairo_surface_destroy (surface);
 		return;
-	item = g_ptr_array_index (priv->tongue_buffer, y);
-	if (item->valid) {
-		if (value < item->min)
-			item->min = value;
-		if (value > item->max)
-			item->max = value;
-	} else {
-		item->min = value;
-		item->valid = TRUE;
 	}
+
+	/* swap the preview for the real thing */
+	g_clear_object (&priv->cancellable);
+	g_clear_pointer (&priv->preview, cairo_surface_destroy);
+	priv->tongue = surface;
+	gcm_cie_widget_invalidate (cie);
+	gtk_widget_queue_draw (GTK_WIDGET (cie));
 }
 
 static void
-gcm_cie_widget_add_point (GcmCieWidget *cie, gdouble icx, gdouble icy, gdouble icx_last, gdouble icy_last)
+gcm_cie_widget_ensure_tongue (GcmCieWidget *cie)
 {
-	gdouble grad;
-	gdouble i;
-	gdouble dy, dx;
-	gdouble c;
-	gdouble x;
-
-	/* nothing to plot */
-	if (icx > cie->priv->chart_width)
-		return;
-	if (icy > cie->priv->chart_height)
-		return;
+	GcmCieMapping map;
+	GcmCieWidgetJob *job;
+	GTask *task;
+	GcmCieWidgetPrivate *priv = cie->priv;
 
-	/* nothing to plot */
-	if (icx == icx_last && icy == icy_last)
+	/* already rendered, or being rendered */
+	if (priv->tongue != NULL || priv->cancellable != NULL)
 		return;
 
-	/* no change in y axis */
-	if (icy == icy_last)
-		return;
+	/* at the resolution of the surface it is drawn on */
+	priv->tongue_width = priv->chart_width * priv->surface_scale;
+	priv->tongue_height = priv->chart_height * priv->surface_scale;
+	priv->tongue_scale = priv->surface_scale;
+	gcm_cie_widget_get_device_mapping (cie, priv->tongue_scale, &map);
 
-	/* trivial */
-	if (icx == icx_last) {
-		for (i=icy; i<=icy_last; i++)
-			gcm_cie_widget_save_point (cie, i, icx);
-		for (i=icy_last; i<=icy; i++)
-			gcm_cie_widget_save_point (cie, i, icx);
+	/* save for speed */
+	gcm_cie_widget_get_min_max_tongue (cie, &map);
+
+	if (!priv->async) {
+		priv->tongue = gcm_cie_widget_render_tongue (&priv->cs, &map,
+							     priv->spans,
+							     priv->tongue_width,
+							     priv->tongue_height,
+							     priv->tongue_scale,
+							     NULL);
 		return;
 	}
 
-	/* plot on the buffer */
-	dy = icy - icy_last;
-	dx = icx - icx_last;
-	grad = ((gdouble) dy) / ((gdouble) dx);
-	c = icy - (grad * (gdouble) icx);
-	for (i=icy; i<=icy_last; i++) {
-		x = (i - c) / grad;
-		gcm_cie_widget_save_point (cie, i, x);
-	}
-	for (i=icy_last; i<=icy; i++) {
-		x = (i - c) / grad;
-		gcm_cie_widget_save_point (cie, i, x);
-	}
+	/* show something straight away, and do the real work in a thread */
+	priv->preview = gcm_cie_widget_render_preview (cie, &map, priv->spans);
+	job = g_new0 (GcmCieWidgetJob, 1);
+	job->cs = priv->cs;
+	job->map = map;
+	job->spans = g_new (GcmCieSpan, priv->tongue_height);
+	memcpy (job->spans, priv->spans, priv->tongue_height * sizeof (GcmCieSpan));
+	job->width = priv->tongue_width;
+	job->height = priv->tongue_height;
+	job->scale = priv->tongue_scale;
+	priv->cancellable = g_cancellable_new ();
+	task = g_task_new (cie, priv->cancellable,
+			   gcm_cie_widget_render_done_cb, NULL);
+	g_task_set_task_data (task, job, (GDestroyNotify) gcm_cie_widget_job_free);
+	g_task_run_in_thread (task, gcm_cie_widget_render_thread_cb);
+	g_object_unref (task);
 }
 
 static void
-gcm_cie_widget_get_min_max_tongue (GcmCieWidget *cie)
+gcm_cie_widget_draw_mesh (GcmCieWidget *cie, cairo_t *cr)
 {
-	guint wavelength;
-	gdouble icx, icy;
-	gdouble icx_last, icy_last;
-	GcmCieWidgetBufferItem *item;
-	guint i;
+	GcmCieMapping map;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
-	/* add enough elements to the array */
-	g_ptr_array_set_size (priv->tongue_buffer, 0);
-	for (i = 0; i < priv->chart_height; i++) {
-		item = g_new0 (GcmCieWidgetBufferItem, 1);
-		g_ptr_array_add (priv->tongue_buffer, item);
-	}
+	/* the mesh does not depend on the size */
+	if (priv->mesh == NULL)
+		priv->mesh = gcm_cie_render_create_mesh (&priv->cs, GCM_CIE_WIDGET_MESH_STEPS);
+	gcm_cie_widget_get_mapping (cie, &map);
+	gcm_cie_render_paint_mesh (cr, priv->mesh, &map);
+}
 
-	/* get first co-ordinate */
-	gcm_cie_widget_compute_monochrome_color_location (cie, 380, &icx_last, &icy_last);
+static void
+gcm_cie_widget_draw_line (GcmCieWidget *cie, cairo_t *cr)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
 
-	/* this is fast path */
-	for (wavelength = 380+1; wavelength <= 700; wavelength++) {
-		gcm_cie_widget_compute_monochrome_color_location (cie, wavelength, &icx, &icy);
-		gcm_cie_widget_add_point (cie, icx, icy, icx_last, icy_last);
-		icx_last = icx;
-		icy_last = icy;
+	if (priv->engine == GCM_CIE_ENGINE_MESH) {
+		gcm_cie_widget_draw_mesh (cie, cr);
+		return;
 	}
 
-	/* add data */
-	gcm_cie_widget_compute_monochrome_color_location (cie, 380, &icx, &icy);
-	gcm_cie_widget_add_point (cie, icx, icy, icx_last, icy_last);
+	gcm_cie_widget_ensure_tongue (cie);
+
+	/* composite the whole tongue in one go */
+	cairo_save (cr);
+	if (priv->tongue != NULL) {
+		cairo_set_source_surface (cr, priv->tongue, 0, 0);
+		cairo_paint (cr);
+	} else if (priv->preview != NULL) {
+		cairo_scale (cr,
+			     GCM_CIE_WIDGET_PREVIEW_FACTOR,
+			     GCM_CIE_WIDGET_PREVIEW_FACTOR);
+		cairo_set_source_surface (cr, priv->preview, 0, 0);
+		cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+		cairo_paint (cr);
+	}
+	cairo_restore (cr);
 }
 
 static void
-gcm_cie_widget_draw_tongue_outline (GcmCieWidget *cie, cairo_t *cr)
+gcm_cie_widget_style_updated (GtkWidget *widget)
 {
-	guint wavelength;
-	gdouble icx, icy;
-	gdouble icx_last, icy_last;
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
 
-	cairo_save (cr);
-	cairo_set_line_width (cr, 2.0f);
-	cairo_set_source_rgb (cr, 0.5f, 0.5f, 0.5f);
+	/* the font may have changed */
+	GTK_WIDGET_CLASS (gcm_cie_widget_parent_class)->style_updated (widget);
+	if (cie->priv->labels != NULL)
+		gcm_label_cache_invalidate (cie->priv->labels);
+	gcm_cie_widget_invalidate (cie);
+}
 
-	/* get first co-ordinate */
-	gcm_cie_widget_compute_monochrome_color_location (cie, 380, &icx_last, &icy_last);
-	cairo_move_to (cr, icx_last, icy_last);
+static void
+gcm_cie_widget_draw_labels (GcmCieWidget *cie, cairo_t *cr)
+{
+	const guint wavelengths[] = { 460, 480, 500, 520, 540, 560, 580, 600, 620, 0 };
+	GcmCieMapping map;
+	gchar text[16];
+	gdouble dx, dy, len;
+	gdouble ox, oy;
+	gdouble wx, wy;
+	gdouble x, y;
+	guint i;
 
-	/* this is fast path */
-	for (wavelength = 380+1; wavelength <= 700; wavelength++) {
+	gcm_cie_widget_get_mapping (cie, &map);
 
-		/* get point */
-		gcm_cie_widget_compute_monochrome_color_location (cie, wavelength, &icx, &icy);
+	/* along the bottom and left axes */
+	gcm_cie_render_map_to_display (&map, 0.0f, 0.0f, &ox, &oy);
+	for (i = 1; i <= 8; i++) {
+		g_snprintf (text, sizeof (text), "%.1f", i / 10.0f);
+		gcm_cie_render_map_to_display (&map, i / 10.0f, i / 10.0f, &wx, &wy);
+		if (i <= 7)
+			gcm_label_cache_paint (cie->priv->labels, cr, text, wx, oy + 2, 0.5f, 0.0f);
+		gcm_label_cache_paint (cie->priv->labels, cr, text, ox - 2, wy, 1.0f, 0.5f);
+	}
 
-		/* nothing to plot */
-		if (icx == icx_last && icy == icy_last)
+	/* wavelengths, pointing away from the middle of the tongue */
+	cairo_save (cr);
+	cairo_set_line_width (cr, 1);
+	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
+	gcm_cie_render_map_to_display (&map, 0.33f, 0.33f, &ox, &oy);
+	for (i = 0; wavelengths[i] != 0; i++) {
+		gcm_cie_render_get_spectral_chromaticity (wavelengths[i], &x, &y);
+		gcm_cie_render_map_to_display (&map, x, y, &wx, &wy);
+		dx = wx - ox;
+		dy = wy - oy;
+		len = sqrt (dx * dx + dy * dy);
+		if (len < 1.0f)
 			continue;
+		dx /= len;
+		dy /= len;
+		cairo_move_to (cr, wx, wy);
+		cairo_line_to (cr, wx + dx * 4, wy + dy * 4);
+		cairo_stroke (cr);
+		g_snprintf (text, sizeof (text), "%u", wavelengths[i]);
+		gcm_label_cache_paint (cie->priv->labels, cr, text,
+				       wx + dx * 6, wy + dy * 6,
+				       0.5f - 0.5f * dx, 0.5f - 0.5f * dy);
+	}
+	cairo_restore (cr);
+}
 
-		/* draw line */
-		cairo_line_to (cr, icx, icy);
+static void
+gcm_cie_widget_draw_planckian (GcmCieWidget *cie, cairo_t *cr)
+{
+	const guint temperatures[] = { 2000, 2500, 3000, 4000, 5000, 6500, 10000, 0 };
+	GcmCieMapping map;
+	gboolean first = TRUE;
+	gchar text[16];
+	gdouble wx, wy;
+	gdouble x, y;
+	guint mired;
+	guint i;
 
-		icx_last = icx;
-		icy_last = icy;
-	}
+	gcm_cie_widget_get_mapping (cie, &map);
+	cairo_save (cr);
+	cairo_set_line_width (cr, 1);
+	cairo_set_source_rgba (cr, 0.1, 0.1, 0.1, 0.8);
 
-	/* join bottom */
-	cairo_close_path (cr);
-	cairo_stroke_preserve (cr);
-	cairo_set_line_width (cr, 1.0f);
-	cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
+	/* the blackbody locus, evenly spaced in mired */
+	for (mired = 600; mired > 0; mired -= 5) {
+		if (!gcm_cct_to_xy (1e6 / mired, 0.0f, &x, &y))
+			continue;
+		gcm_cie_render_map_to_display (&map, x, y, &wx, &wy);
+		if (first)
+			cairo_move_to (cr, wx, wy);
+		else
+			cairo_line_to (cr, wx, wy);
+		first = FALSE;
+	}
 	cairo_stroke (cr);
 
+	/* isotemperature lines, labelled below the locus */
+	for (i = 0; temperatures[i] != 0; i++) {
+		gcm_cct_to_xy (temperatures[i], 0.02f, &x, &y);
+		gcm_cie_render_map_to_display (&map, x, y, &wx, &wy);
+		cairo_move_to (cr, wx, wy);
+		gcm_cct_to_xy (temperatures[i], -0.02f, &x, &y);
+		gcm_cie_render_map_to_display (&map, x, y, &wx, &wy);
+		cairo_line_to (cr, wx, wy);
+		cairo_stroke (cr);
+		g_snprintf (text, sizeof (text), "%uK", temperatures[i]);
+		gcm_label_cache_paint (cie->priv->labels, cr, text,
+				       wx, wy + 1, 0.5f, 0.0f);
+	}
 	cairo_restore (cr);
 }
 
-/**
- * gcm_cie_widget_xyz_to_rgb:
- *
- * Given an additive tricolor system CS, defined by the CIE x and y
- * chromaticities of its three primaries (z is derived trivially as
- * 1- (x+y)), and a desired chromaticity (XC, YC, ZC) in CIE space,
- * determine the contribution of each primary in a linear combination
- * which sums to the desired chromaticity. If the requested
- * chromaticity falls outside the Maxwell triangle (color gamut)
- * formed by the three primaries, one of the r, g, or b weights will
- * be negative.
- *
- * Caller can use gcm_cie_widget_constrain_rgb () to desaturate an outside-gamut
- * color to the closest representation within the available
- * gamut.
- **/
 static void
-gcm_cie_widget_xyz_to_rgb (GcmCieWidget *cie,
-			   gdouble xc, gdouble yc, gdouble zc,
-			   gdouble *r, gdouble *g, gdouble *b)
+gcm_cie_widget_draw_overlays (GcmCieWidget *cie, cairo_t *cr, const GcmCieMapping *map)
 {
-	gdouble xr, yr, zr, xg, yg, zg, xb, yb, zb;
-	gdouble xw, yw, zw;
-	gdouble rx, ry, rz, gx, gy, gz, bx, by, bz;
-	gdouble rw, gw, bw;
-	GcmCieWidgetPrivate *priv = cie->priv;
-
-	xr = priv->red->x; yr = priv->red->y; zr = 1 - (xr + yr);
-	xg = priv->green->x; yg = priv->green->y; zg = 1 - (xg + yg);
-	xb = priv->blue->x; yb = priv->blue->y; zb = 1 - (xb + yb);
-
-	xw = priv->white->x; yw = priv->white->y; zw = 1 - (xw + yw);
-
-	/* xyz -> rgb matrix, before scaling to white-> */
-	rx = yg*zb - yb*zg; ry = xb*zg - xg*zb; rz = xg*yb - xb*yg;
-	gx = yb*zr - yr*zb; gy = xr*zb - xb*zr; gz = xb*yr - xr*yb;
-	bx = yr*zg - yg*zr; by = xg*zr - xr*zg; bz = xr*yg - xg*yr;
+	GcmCieWidgetOverlay *overlay;
+	const gdouble dashed[] = { 6.0, 3.0 };
+	const gdouble dotted[] = { 1.0, 2.0 };
+	gdouble wx, wy;
+	guint i;
 
-	/* white scaling factors - dividing by yw scales the white luminance to unity */
-	rw = (rx*xw + ry*yw + rz*zw) / yw;
-	gw = (gx*xw + gy*yw + gz*zw) / yw;
-	bw = (bx*xw + by*yw + bz*zw) / yw;
+	for (i = 0; i < cie->priv->overlays->len; i++) {
+		overlay = g_ptr_array_index (cie->priv->overlays, i);
 
-	/* xyz -> rgb matrix, correctly scaled to white-> */
-	rx = rx / rw; ry = ry / rw; rz = rz / rw;
-	gx = gx / gw; gy = gy / gw; gz = gz / gw;
-	bx = bx / bw; by = by / bw; bz = bz / bw;
+		/* profile has no primaries */
+		if (overlay->white.x < 0.001)
+			continue;
 
-	/* rgb of the desired point */
-	*r = rx*xc + ry*yc + rz*zc;
-	*g = gx*xc + gy*yc + gz*zc;
-	*b = bx*xc + by*yc + bz*zc;
-}
+		cairo_save (cr);
+		cairo_set_line_width (cr, 1.5f);
+		gdk_cairo_set_source_rgba (cr, &overlay->color);
+		if (overlay->style == GCM_CIE_OVERLAY_STYLE_DASHED)
+			cairo_set_dash (cr, dashed, 2, 0.0);
+		else if (overlay->style == GCM_CIE_OVERLAY_STYLE_DOTTED)
+			cairo_set_dash (cr, dotted, 2, 0.0);
+
+		gcm_cie_render_map_to_display (map, overlay->red.x, overlay->red.y, &wx, &wy);
+		cairo_move_to (cr, wx, wy);
+		gcm_cie_render_map_to_display (map, overlay->green.x, overlay->green.y, &wx, &wy);
+		cairo_line_to (cr, wx, wy);
+		gcm_cie_render_map_to_display (map, overlay->blue.x, overlay->blue.y, &wx, &wy);
+		cairo_line_to (cr, wx, wy);
+		cairo_close_path (cr);
+		cairo_stroke (cr);
 
-/**
- * gcm_cie_widget_constrain_rgb:
- *
- * If the requested RGB shade contains a negative weight for one of
- * the primaries, it lies outside the color gamut accessible from
- * the given triple of primaries. Desaturate it by adding white,
- * equal quantities of R, G, and B, enough to make RGB all positive.
- **/
-static gboolean
-gcm_cie_widget_constrain_rgb (gdouble *r, gdouble *g, gdouble *b)
-{
-	gdouble w;
-
-	/* amount of white needed is w = - min (0, *r, *g, *b) */
-	w = (0 < *r) ? 0 : *r;
-	w = (w < *g) ? w : *g;
-	w = (w < *b) ? w : *b;
-	w = - w;
-
-	/* add just enough white to make r, g, b all positive. */
-	if (w > 0) {
-		*r += w; *g += w; *b += w;
-		return TRUE; /* color modified to fit RGB gamut */
+		/* a dot for the white point */
+		gcm_cie_render_map_to_display (map, overlay->white.x, overlay->white.y, &wx, &wy);
+		cairo_arc (cr, wx, wy, 2.0f, 0, 2 * G_PI);
+		cairo_fill (cr);
+		cairo_restore (cr);
 	}
-
-	return FALSE; /* color within RGB gamut */
 }
 
-/**
- * gcm_cie_widget_gamma_correct:
- *
- * Transform linear RGB values to nonlinear RGB values.
- *
- * Rec. 709 is ITU-R Recommendation BT. 709 (1990)
- * ``Basic Parameter Values for the HDTV Standard for the Studio and for
- * International Programme Exchange'', formerly CCIR Rec. 709.
- *
- * For details see
- * http://www.inforamp.net/~poynton/ColorFAQ.html
- * http://www.inforamp.net/~poynton/GammaFAQ.html
- **/
 static void
-gcm_cie_widget_gamma_correct (GcmCieWidget *cie, gdouble *c)
+gcm_cie_widget_draw_foreground (GcmCieWidget *cie, cairo_t *cr)
 {
+	GcmCieMapping map;
+	GcmCieRenderParams params;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
-	if (priv->gamma == 0.0) {
-		/* rec. 709 gamma correction. */
-		gdouble cc = 0.018;
-		if (*c < cc) {
-			*c *= (1.099 * powf (cc, 0.45) - 0.099) / cc;
-		} else {
-			*c = 1.099 * powf (*c, 0.45) - 0.099;
-		}
-	} else {
-		/* Nonlinear color = (Linear color)^ (1/gamma) */
-		*c = powf (*c, 1.0/priv->gamma);
+	/* overdraw lines with nice antialiasing */
+	gcm_cie_widget_get_mapping (cie, &map);
+	if (priv->heatmap != NULL)
+		gcm_cie_histogram_paint (cr, priv->heatmap, &map);
+	gcm_cie_render_draw_locus (cr, &map);
+	gcm_cie_render_draw_gamut (cr, &map, priv->red, priv->green, priv->blue);
+	gcm_cie_widget_draw_overlays (cie, cr, &map);
+
+	if (priv->use_whitepoint) {
+		gcm_cie_widget_get_params (cie, &params);
+		gcm_cie_render_draw_white_point (cr, &map, &params,
+						 priv->chart_width);
 	}
 }
 
 static void
-gcm_cie_widget_gamma_correct_rgb (GcmCieWidget *cie,
-				  gdouble *r, gdouble *g, gdouble *b)
+gcm_cie_widget_transform_surface (GcmCieWidget *cie)
 {
-	gcm_cie_widget_gamma_correct (cie, r);
-	gcm_cie_widget_gamma_correct (cie, g);
-	gcm_cie_widget_gamma_correct (cie, b);
+	GcmCieRenderParams params;
+	cmsHPROFILE profile;
+	GcmCieWidgetPrivate *priv = cie->priv;
+
+	/* shown as-is */
+	if (priv->display_profile == NULL)
+		return;
+
+	/* only created again when a profile changes */
+	if (priv->display_transform == NULL) {
+		gcm_cie_widget_get_params (cie, &params);
+		profile = gcm_cie_render_create_profile (&params);
+		priv->display_transform = gcm_utils_create_display_transform (profile,
+									      priv->display_profile);
+		cmsCloseProfile (profile);
+		if (priv->display_transform == NULL) {
+			g_warning ("failed to create display transform");
+			return;
+		}
+	}
+	gcm_utils_transform_surface (priv->display_transform, priv->surface);
 }
 
 static void
-gcm_cie_widget_draw_gamut_outline (GcmCieWidget *cie, cairo_t *cr)
+gcm_cie_widget_ensure_surface (GcmCieWidget *cie, gint scale)
 {
-	gdouble wx;
-	gdouble wy;
+	cairo_t *cr;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
-	cairo_save (cr);
+	/* still valid for this size and scale */
+	if (priv->surface != NULL &&
+	    priv->surface_width == priv->chart_width &&
+	    priv->surface_height == priv->chart_height &&
+	    priv->surface_scale == scale)
+		return;
 
-	cairo_set_line_width (cr, 0.9f);
-	cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
+	/* the tongue only has to be rendered again for a new size */
+	if (priv->tongue_width != priv->chart_width * scale ||
+	    priv->tongue_height != priv->chart_height * scale ||
+	    priv->tongue_scale != scale)
+		gcm_cie_widget_invalidate_tongue (cie);
+
+	gcm_cie_widget_invalidate (cie);
+	priv->surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+						    priv->chart_width * scale,
+						    priv->chart_height * scale);
+	cairo_surface_set_device_scale (priv->surface, scale, scale);
+	priv->surface_width = priv->chart_width;
+	priv->surface_height = priv->chart_height;
+	priv->surface_scale = scale;
+
+	/* render the layers that only depend on the size and the primaries */
+	cr = cairo_create (priv->surface);
+	gcm_cie_render_draw_background (cr, priv->chart_width, priv->chart_height,
+					priv->use_grid);
+	gcm_cie_widget_draw_line (cie, cr);
+	if (priv->use_planckian)
+		gcm_cie_widget_draw_planckian (cie, cr);
+	gcm_cie_widget_draw_labels (cie, cr);
+
+	/* the whole image is converted for the display, not just the tongue */
+	if (priv->display_profile != NULL)
+		gcm_cie_widget_draw_foreground (cie, cr);
+	cairo_destroy (cr);
+	gcm_cie_widget_transform_surface (cie);
+}
 
-	gcm_cie_widget_map_to_display (cie, priv->red->x, priv->red->y, &wx, &wy);
-	if (wx < 0 || wy < 0)
-		goto out;
-	cairo_move_to (cr, wx, wy);
+static gboolean
+gcm_cie_widget_resize_cb (gpointer user_data)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (user_data);
 
-	gcm_cie_widget_map_to_display (cie, priv->green->x, priv->green->y, &wx, &wy);
-	if (wx < 0 || wy < 0)
-		goto out;
-	cairo_line_to (cr, wx, wy);
+	/* the size has settled, so do the exact render */
+	cie->priv->resize_id = 0;
+	gtk_widget_queue_draw (GTK_WIDGET (cie));
+	return G_SOURCE_REMOVE;
+}
 
-	gcm_cie_widget_map_to_display (cie, priv->blue->x, priv->blue->y, &wx, &wy);
-	if (wx < 0 || wy < 0)
-		goto out;
-	cairo_line_to (cr, wx, wy);
+static gboolean
+gcm_cie_widget_is_resizing (GcmCieWidget *cie)
+{
+	GcmCieWidgetPrivate *priv = cie->priv;
 
-	cairo_close_path (cr);
-	cairo_stroke (cr);
-out:
-	cairo_restore (cr);
+	/* nothing to scale, or nothing to do */
+	if (priv->surface == NULL)
+		return FALSE;
+	if (priv->surface_width == priv->chart_width &&
+	    priv->surface_height == priv->chart_height)
+		return FALSE;
+
+	/* still being dragged, so wait until the size is stable */
+	if (priv->resize_width != priv->chart_width ||
+	    priv->resize_height != priv->chart_height) {
+		priv->resize_width = priv->chart_width;
+		priv->resize_height = priv->chart_height;
+		if (priv->resize_id != 0)
+			g_source_remove (priv->resize_id);
+		priv->resize_id = g_timeout_add (GCM_CIE_WIDGET_RESIZE_TIMEOUT,
+						 gcm_cie_widget_resize_cb, cie);
+		return TRUE;
+	}
+	return priv->resize_id != 0;
 }
 
 static void
-gcm_cie_widget_draw_white_point_cross (GcmCieWidget *cie, cairo_t *cr)
+gcm_cie_widget_draw_scaled (GcmCieWidget *cie, cairo_t *cr)
 {
-	gdouble wx;
-	gdouble wy;
-	gdouble size;
-	gdouble gap;
 	GcmCieWidgetPrivate *priv = cie->priv;
 
+	/* stretch the last exact render to the new size */
 	cairo_save (cr);
-
-	/* scale the cross according the the widget size */
-	size = priv->chart_width / 35.0f;
-	gap = size / 2.0f;
-
-	cairo_set_line_width (cr, 1.0f);
-
-	/* choose color of cross */
-	if (priv->red->x < 0.001 && priv->green->x < 0.001 && priv->blue->x < 0.001)
-		cairo_set_source_rgb (cr, 1.0f, 1.0f, 1.0f);
-	else
-		cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.0f);
-
-	gcm_cie_widget_map_to_display (cie, priv->white->x, priv->white->y, &wx, &wy);
-
-	/* don't antialias the cross */
-	wx = (gint) wx + 0.5f;
-	wy = (gint) wy + 0.5f;
-
-	/* left */
-	cairo_move_to (cr, wx - gap, wy);
-	cairo_line_to (cr, wx - gap - size, wy);
-	cairo_stroke (cr);
-
-	/* right */
-	cairo_move_to (cr, wx + gap, wy);
-	cairo_line_to (cr, wx + gap + size, wy);
-	cairo_stroke (cr);
-
-	/* top */
-	cairo_move_to (cr, wx, wy - gap);
-	cairo_line_to (cr, wx, wy - gap - size);
-	cairo_stroke (cr);
-
-	/* bottom */
-	cairo_move_to (cr, wx, wy + gap);
-	cairo_line_to (cr, wx, wy + gap + size);
-	cairo_stroke (cr);
-
+	cairo_scale (cr,
+		     (gdouble) priv->chart_width / (gdouble) priv->surface_width,
+		     (gdouble) priv->chart_height / (gdouble) priv->surface_height);
+	cairo_set_source_surface (cr, priv->surface, 0, 0);
+	cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_BILINEAR);
+	cairo_paint (cr);
 	cairo_restore (cr);
 }
 
 static void
-gcm_cie_widget_draw_line (GcmCieWidget *cie, cairo_t *cr)
+gcm_cie_widget_update_readout (GcmCieWidget *cie)
 {
+	GcmCieMapping map;
+	PangoRectangle rect;
+	gboolean ret;
+	gdouble wavelength;
 	gdouble x, y;
 	GcmCieWidgetPrivate *priv = cie->priv;
-	GcmCieWidgetBufferItem *item;
+	gchar *text;
 
-	/* save for speed */
-	gcm_cie_widget_get_min_max_tongue (cie);
+	/* nothing to show */
+	if (!priv->hover || priv->chart_width <= 1 || priv->chart_height <= 1) {
+		priv->readout.width = 0;
+		priv->readout.height = 0;
+		return;
+	}
 
-	cairo_save (cr);
-	for (y = 0; y < priv->chart_height; ++y) {
+	/* the table makes this cheap enough for every motion event */
+	gcm_cie_widget_get_mapping (cie, &map);
+	gcm_cie_render_map_from_display (&map, priv->hover_x, priv->hover_y, &x, &y);
+	ret = gcm_cie_hue_table_lookup (&priv->hue, x, y, &wavelength);
+	text = g_strdup_printf ("x %.4f, y %.4f\n%s %.0f nm\n%s",
+				x, y,
+				ret ? _("Dominant wavelength") : _("Complementary wavelength"),
+				wavelength,
+				gcm_cie_render_in_gamut (priv->red, priv->green, priv->blue, x, y) ?
+					_("Inside the profile gamut") :
+					_("Outside the profile gamut"));
+
+	/* only lay the text out again when it changes */
+	if (g_strcmp0 (text, priv->readout_text) != 0) {
+		pango_layout_set_text (priv->readout_layout, text, -1);
+		g_free (priv->readout_text);
+		priv->readout_text = text;
+	} else {
+		g_free (text);
+	}
 
-		/* get buffer data to se if there's any point rendering this line */
-		item = g_ptr_array_index (priv->tongue_buffer, (guint)y);
-		if (!item->valid)
-			continue;
+	/* top right, where the diagram is empty */
+	pango_layout_get_pixel_extents (priv->readout_layout, NULL, &rect);
+	priv->readout.width = rect.width + 8;
+	priv->readout.height = rect.height + 8;
+	priv->readout.x = priv->chart_width - priv->readout.width - 6;
+	priv->readout.y = 6;
+}
 
-		for (x=item->min; x < item->max; x++) {
-
-			gdouble cx, cy, cz;
-			gdouble jr, jg, jb;
-			gdouble r, g, b, mx;
-			gdouble jmax;
-
-			/* scale for display */
-			gcm_cie_widget_map_from_display (cie, x, y, &cx, &cy);
-			cz = 1.0 - (cx + cy);
-
-			gcm_cie_widget_xyz_to_rgb (cie, cx, cy, cz, &jr, &jg, &jb);
-			mx = 1.0f;
-
-			/* Check whether the requested color is within the
-			 * gamut achievable with the given color system. If
-			 * not, draw it in a reduced intensity, interpolated
-			 * by desaturation to the closest within-gamut color.
-			 */
-			if (gcm_cie_widget_constrain_rgb (&jr, &jg, &jb))
-				mx = (1.0 * 3) / 4;
-
-			/* Scale to max (rgb) = 1. */
-			jmax = MAX (jr, MAX (jg, jb));
-			if (jmax > 0) {
-				jr = jr / jmax;
-				jg = jg / jmax;
-				jb = jb / jmax;
-			}
-
-			/* gamma correct from linear rgb to nonlinear rgb. */
-			gcm_cie_widget_gamma_correct_rgb (cie, &jr, &jg, &jb);
-			r = mx * jr;
-			g = mx * jg;
-			b = mx * jb;
-
-			cairo_set_source_rgb (cr, r, g, b);
-			/* convert to an integer to avoid antialiasing, which
-			 * speeds things up significantly */
-			cairo_rectangle (cr, (guint)x, (guint)y, 1, 1);
-			cairo_fill (cr);
-		}
+static void
+gcm_cie_widget_queue_draw_readout (GcmCieWidget *cie)
+{
+	GtkWidget *widget = GTK_WIDGET (cie);
+	GcmCieWidgetPrivate *priv = cie->priv;
+
+	/* the old and new text, and nothing else */
+	if (priv->readout.width > 0) {
+		gtk_widget_queue_draw_area (widget,
+					    priv->readout.x, priv->readout.y,
+					    priv->readout.width, priv->readout.height);
 	}
+	gcm_cie_widget_update_readout (cie);
+	if (priv->readout.width > 0) {
+		gtk_widget_queue_draw_area (widget,
+					    priv->readout.x, priv->readout.y,
+					    priv->readout.width, priv->readout.height);
+	}
+}
 
-	cairo_restore (cr);
+static gboolean
+gcm_cie_widget_motion_notify_event (GtkWidget *widget, GdkEventMotion *event)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+	cie->priv->hover = TRUE;
+	cie->priv->hover_x = event->x;
+	cie->priv->hover_y = event->y;
+	gcm_cie_widget_queue_draw_readout (cie);
+	return FALSE;
+}
 
-	/* overdraw lines with nice antialiasing */
-	gcm_cie_widget_draw_tongue_outline (cie, cr);
-	gcm_cie_widget_draw_gamut_outline (cie, cr);
+static gboolean
+gcm_cie_widget_leave_notify_event (GtkWidget *widget, GdkEventCrossing *event)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+	cie->priv->hover = FALSE;
+	gcm_cie_widget_queue_draw_readout (cie);
+	return FALSE;
 }
 
 static void
-gcm_cie_widget_draw_bounding_box (cairo_t *cr, gint x, gint y, gint width, gint height)
+gcm_cie_widget_draw_readout (GcmCieWidget *cie, cairo_t *cr)
 {
-	/* background */
-	cairo_rectangle (cr, x, y, width, height);
-	cairo_set_source_rgb (cr, 1, 1, 1);
-	cairo_fill (cr);
+	GcmCieWidgetPrivate *priv = cie->priv;
 
-	/* solid outline box */
-	cairo_rectangle (cr, x + 0.5f, y + 0.5f, width - 1, height - 1);
+	/* the white point may have changed since the last motion */
+	gcm_cie_widget_update_readout (cie);
+	if (priv->readout.width == 0)
+		return;
+
+	cairo_save (cr);
+	cairo_rectangle (cr,
+			 priv->readout.x + 0.5f, priv->readout.y + 0.5f,
+			 priv->readout.width - 1, priv->readout.height - 1);
+	cairo_set_source_rgba (cr, 1.0f, 1.0f, 1.0f, 0.8f);
+	cairo_fill_preserve (cr);
 	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
 	cairo_set_line_width (cr, 1);
 	cairo_stroke (cr);
+	cairo_move_to (cr, priv->readout.x + 4, priv->readout.y + 4);
+	pango_cairo_show_layout (cr, priv->readout_layout);
+	cairo_restore (cr);
 }
 
 static void
@@ -1084,21 +1296,28 @@ gcm_cie_widget_draw_cie (GtkWidget *cie_widget, cairo_t *cr)
 
 	/* make size adjustment */
 	gtk_widget_get_allocation (cie_widget, &allocation);
+	if (allocation.width <= 1 || allocation.height <= 1)
+		goto out;
 	cie->priv->chart_height = allocation.height;
 	cie->priv->chart_width = allocation.width;
-	cie->priv->x_offset = cie->priv->chart_width / 18.0f;
-	cie->priv->y_offset = cie->priv->chart_height / 20.0f;
 
-	/* cie background */
-	gcm_cie_widget_draw_bounding_box (cr, 0, 0, cie->priv->chart_width, cie->priv->chart_height);
-	if (cie->priv->use_grid)
-		gcm_cie_widget_draw_grid (cie, cr);
+	/* only rebuild the layers that changed since the last frame */
+	gcm_cie_widget_flush_dirty (cie);
 
-	gcm_cie_widget_draw_line (cie, cr);
-
-	if (cie->priv->use_whitepoint)
-		gcm_cie_widget_draw_white_point_cross (cie, cr);
+	/* cie background and tongue, only rendered when something changed */
+	if (gcm_cie_widget_is_resizing (cie)) {
+		gcm_cie_widget_draw_scaled (cie, cr);
+	} else {
+		gcm_cie_widget_ensure_surface (cie, gtk_widget_get_scale_factor (cie_widget));
+		cairo_set_source_surface (cr, cie->priv->surface, 0, 0);
+		cairo_paint (cr);
+	}
 
+	/* already in the cached layers when converted for the display */
+	if (cie->priv->display_profile == NULL)
+		gcm_cie_widget_draw_foreground (cie, cr);
+	gcm_cie_widget_draw_readout (cie, cr);
+out:
 	cairo_restore (cr);
 }
 
@@ -1115,3 +1334,28 @@ gcm_cie_widget_new (void)
 	return g_object_new (GCM_TYPE_CIE_WIDGET, NULL);
 }
 
+
+/**
+ * gcm_cie_widget_render_to_surface:
+ * @widget: a #GcmCieWidget
+ * @width: the diagram width
+ * @height: the diagram height
+ * @scale: the device scale
+ *
+ * Renders the diagram with the current settings of the widget, which
+ * does not have to be realized or even shown.
+ *
+ * Return value: a new image surface, free with cairo_surface_destroy()
+ **/
+cairo_surface_t *
+gcm_cie_widget_render_to_surface (GtkWidget *widget,
+				  guint width,
+				  guint height,
+				  gint scale)
+{
+	GcmCieWidget *cie = GCM_CIE_WIDGET (widget);
+	GcmCieRenderParams params;
+
+	gcm_cie_widget_get_params (cie, &params);
+	return gcm_cie_render_to_surface (&params, width, height, scale);
+}
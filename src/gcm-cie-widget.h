@@ -10,6 +10,9 @@
 #include <gtk/gtk.h>
 #include <colord.h>
 
+#include "gcm-cie-histogram.h"
+#include "gcm-cie-render.h"
+
 #define GCM_TYPE_CIE_WIDGET		(gcm_cie_widget_get_type ())
 #define GCM_CIE_WIDGET(obj)		(G_TYPE_CHECK_INSTANCE_CAST ((obj), GCM_TYPE_CIE_WIDGET, GcmCieWidget))
 #define GCM_CIE_WIDGET_CLASS(obj)	(G_TYPE_CHECK_CLASS_CAST ((obj), GCM_CIE_WIDGET, GcmCieWidgetClass))
@@ -17,6 +20,13 @@
 #define GCM_IS_CIE_WIDGET_CLASS(obj)	(G_TYPE_CHECK_CLASS_TYPE ((obj), EFF_TYPE_CIE_WIDGET))
 #define GCM_CIE_WIDGET_GET_CLASS	(G_TYPE_INSTANCE_GET_CLASS ((obj), GCM_TYPE_CIE_WIDGET, GcmCieWidgetClass))
 
+typedef enum {
+	GCM_CIE_OVERLAY_STYLE_SOLID,
+	GCM_CIE_OVERLAY_STYLE_DASHED,
+	GCM_CIE_OVERLAY_STYLE_DOTTED,
+	GCM_CIE_OVERLAY_STYLE_LAST
+} GcmCieOverlayStyle;
+
 typedef struct GcmCieWidget		GcmCieWidget;
 typedef struct GcmCieWidgetClass	GcmCieWidgetClass;
 typedef struct GcmCieWidgetPrivate	GcmCieWidgetPrivate;
@@ -36,3 +46,16 @@ GType		 gcm_cie_widget_get_type		(void);
 GtkWidget	*gcm_cie_widget_new			(void);
 void		 gcm_cie_widget_set_from_profile	(GtkWidget	*widget,
 							 CdIcc		*profile);
+cairo_surface_t	*gcm_cie_widget_render_to_surface	(GtkWidget	*widget,
+							 guint		 width,
+							 guint		 height,
+							 gint		 scale);
+guint		 gcm_cie_widget_add_overlay		(GtkWidget	*widget,
+							 CdIcc		*profile,
+							 const GdkRGBA	*color,
+							 GcmCieOverlayStyle style);
+gboolean	 gcm_cie_widget_remove_overlay		(GtkWidget	*widget,
+							 guint		 id);
+void		 gcm_cie_widget_clear_overlays		(GtkWidget	*widget);
+void		 gcm_cie_widget_set_histogram		(GtkWidget	*widget,
+							 GcmCieHistogram *histogram);
@@ -15,6 +15,8 @@
 
 G_DEFINE_TYPE (GcmGammaWidget, gcm_gamma_widget, GTK_TYPE_DRAWING_AREA);
 #define GCM_GAMMA_WIDGET_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GCM_TYPE_GAMMA_WIDGET, GcmGammaWidgetPrivate))
+#define GCM_GAMMA_WIDGET_STEP		(1.0f / 255.0f)	/* for each key press or scroll click */
+#define GCM_GAMMA_WIDGET_IDLE_FRAMES	30		/* before the frame clock is let go */
 
 struct GcmGammaWidgetPrivate
 {
@@ -25,10 +27,21 @@ struct GcmGammaWidgetPrivate
 	gdouble			 color_blue;
 	guint			 chart_width;
 	guint			 chart_height;
+	cairo_pattern_t		*pattern;		/* one dark and one light line */
+	gboolean		 live;			/* adjusted with keys and scrolling */
+	guint			 tick_id;		/* following the frame clock */
+	gboolean		 pending;		/* the box needs drawing this frame */
+	gdouble			 pending_delta;		/* input since the last frame */
+	guint			 idle_frames;
+	gint64			 last_frame_time;	/* us, or 0 if the last frame was idle */
+	gdouble			 frame_time;		/* us between updates, averaged */
 };
 
 static gboolean gcm_gamma_widget_draw (GtkWidget *gamma, cairo_t *cr);
 static void	gcm_gamma_widget_finalize (GObject *object);
+static gboolean gcm_gamma_widget_key_press_event (GtkWidget *widget, GdkEventKey *event);
+static gboolean gcm_gamma_widget_scroll_event (GtkWidget *widget, GdkEventScroll *event);
+static gboolean gcm_gamma_widget_button_press_event (GtkWidget *widget, GdkEventButton *event);
 
 enum
 {
@@ -38,6 +51,8 @@ enum
 	PROP_COLOR_RED,
 	PROP_COLOR_GREEN,
 	PROP_COLOR_BLUE,
+	PROP_LIVE,
+	PROP_FRAME_TIME,
 	PROP_LAST
 };
 
@@ -61,41 +76,145 @@ dkp_gamma_get_property (GObject *object, guint prop_id, GValue *value, GParamSpe
 	case PROP_COLOR_BLUE:
 		g_value_set_double (value, gama->priv->color_blue);
 		break;
+	case PROP_LIVE:
+		g_value_set_boolean (value, gama->priv->live);
+		break;
+	case PROP_FRAME_TIME:
+		g_value_set_double (value, gama->priv->frame_time / 1000.0f);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
 	}
 }
 
+static void
+gcm_gamma_widget_get_box (GcmGammaWidget *gama, cairo_rectangle_int_t *box)
+{
+	guint box_width;
+	guint box_height;
+	guint mid_x;
+	guint mid_y;
+
+	/* half the size in either direction, starting on an even line */
+	box_width = gama->priv->chart_width / 4;
+	box_height = gama->priv->chart_height / 4;
+	mid_x = gama->priv->chart_width / 2;
+	mid_y = gama->priv->chart_height / 2;
+	box->x = mid_x - box_width;
+	box->y = ((mid_y - box_height) / 2) * 2;
+	box->width = box_width * 2;
+	box->height = ((box_height * 2) / 2) * 2;
+}
+
+static gboolean
+gcm_gamma_widget_tick_cb (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data);
+
+static void
+gcm_gamma_widget_ensure_tick (GcmGammaWidget *gama)
+{
+	if (gama->priv->tick_id != 0)
+		return;
+	gama->priv->idle_frames = 0;
+	gama->priv->last_frame_time = 0;
+	gama->priv->tick_id = gtk_widget_add_tick_callback (GTK_WIDGET (gama),
+							    gcm_gamma_widget_tick_cb,
+							    NULL, NULL);
+}
+
+static void
+gcm_gamma_widget_remove_tick (GcmGammaWidget *gama)
+{
+	if (gama->priv->tick_id == 0)
+		return;
+	gtk_widget_remove_tick_callback (GTK_WIDGET (gama), gama->priv->tick_id);
+	gama->priv->tick_id = 0;
+}
+
+static void
+gcm_gamma_widget_invalidate_box (GcmGammaWidget *gama)
+{
+	cairo_rectangle_int_t box;
+
+	/* not drawn yet, so we do not know where the box is */
+	if (gama->priv->chart_width == 0) {
+		gtk_widget_queue_draw (GTK_WIDGET (gama));
+		return;
+	}
+
+	/* the lines around the box have not changed */
+	gcm_gamma_widget_get_box (gama, &box);
+	gtk_widget_queue_draw_area (GTK_WIDGET (gama),
+				    box.x, box.y,
+				    box.width + 2, box.height + 2);
+}
+
+static void
+gcm_gamma_widget_queue_draw_box (GcmGammaWidget *gama)
+{
+	/* drawn at most once on the next frame */
+	if (gama->priv->live) {
+		gama->priv->pending = TRUE;
+		gcm_gamma_widget_ensure_tick (gama);
+		return;
+	}
+	gcm_gamma_widget_invalidate_box (gama);
+}
+
+static void
+gcm_gamma_widget_invalidate_pattern (GcmGammaWidget *gama)
+{
+	if (gama->priv->pattern != NULL) {
+		cairo_pattern_destroy (gama->priv->pattern);
+		gama->priv->pattern = NULL;
+	}
+}
+
 static void
 dkp_gamma_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
 {
 	GcmGammaWidget *gama = GCM_GAMMA_WIDGET (object);
 
+	/* several changes before the next frame only cause one draw */
 	switch (prop_id) {
 	case PROP_COLOR_LIGHT:
 		gama->priv->color_light = g_value_get_double (value);
+		gcm_gamma_widget_invalidate_pattern (gama);
+		gtk_widget_queue_draw (GTK_WIDGET (gama));
 		break;
 	case PROP_COLOR_DARK:
 		gama->priv->color_dark = g_value_get_double (value);
+		gcm_gamma_widget_invalidate_pattern (gama);
+		gtk_widget_queue_draw (GTK_WIDGET (gama));
 		break;
 	case PROP_COLOR_RED:
 		gama->priv->color_red = g_value_get_double (value);
+		gcm_gamma_widget_queue_draw_box (gama);
 		break;
 	case PROP_COLOR_GREEN:
 		gama->priv->color_green = g_value_get_double (value);
+		gcm_gamma_widget_queue_draw_box (gama);
 		break;
 	case PROP_COLOR_BLUE:
 		gama->priv->color_blue = g_value_get_double (value);
+		gcm_gamma_widget_queue_draw_box (gama);
+		break;
+	case PROP_LIVE:
+		gama->priv->live = g_value_get_boolean (value);
+		gtk_widget_set_can_focus (GTK_WIDGET (gama), gama->priv->live);
+		if (!gama->priv->live) {
+			gama->priv->pending_delta = 0.0f;
+			gcm_gamma_widget_remove_tick (gama);
+			if (gama->priv->pending) {
+				gama->priv->pending = FALSE;
+				gcm_gamma_widget_invalidate_box (gama);
+			}
+		}
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
 	}
-
-	/* refresh widget */
-	gtk_widget_hide (GTK_WIDGET (gama));
-	gtk_widget_show (GTK_WIDGET (gama));
 }
 
 static void
@@ -105,6 +224,9 @@ gcm_gamma_widget_class_init (GcmGammaWidgetClass *class)
 	GObjectClass *object_class = G_OBJECT_CLASS (class);
 
 	widget_class->draw = gcm_gamma_widget_draw;
+	widget_class->key_press_event = gcm_gamma_widget_key_press_event;
+	widget_class->scroll_event = gcm_gamma_widget_scroll_event;
+	widget_class->button_press_event = gcm_gamma_widget_button_press_event;
 	object_class->get_property = dkp_gamma_get_property;
 	object_class->set_property = dkp_gamma_set_property;
 	object_class->finalize = gcm_gamma_widget_finalize;
@@ -137,6 +259,20 @@ gcm_gamma_widget_class_init (GcmGammaWidgetClass *class)
 					 g_param_spec_double ("color-blue", NULL, NULL,
 							       0.0f, G_MAXDOUBLE, 0.0f,
 							       G_PARAM_READWRITE));
+
+	/* the box follows the keyboard and scrolling, once for each frame */
+	g_object_class_install_property (object_class,
+					 PROP_LIVE,
+					 g_param_spec_boolean ("live", NULL, NULL,
+							       FALSE,
+							       G_PARAM_READWRITE));
+
+	/* in ms, averaged while the color is changing in live mode */
+	g_object_class_install_property (object_class,
+					 PROP_FRAME_TIME,
+					 g_param_spec_double ("frame-time", NULL, NULL,
+							      0.0f, G_MAXDOUBLE, 0.0f,
+							      G_PARAM_READABLE));
 }
 
 static void
@@ -150,6 +286,9 @@ gcm_gamma_widget_init (GcmGammaWidget *gama)
 	gama->priv->color_red = 0.5f;
 	gama->priv->color_green = 0.5f;
 	gama->priv->color_blue = 0.5f;
+	gtk_widget_add_events (GTK_WIDGET (gama),
+			       GDK_KEY_PRESS_MASK | GDK_BUTTON_PRESS_MASK |
+			       GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK);
 
 	/* do pango stuff */
 	context = gtk_widget_get_pango_context (GTK_WIDGET (gama));
@@ -159,61 +298,197 @@ gcm_gamma_widget_init (GcmGammaWidget *gama)
 static void
 gcm_gamma_widget_finalize (GObject *object)
 {
-//	GcmGammaWidget *gama = (GcmGammaWidget*) object;
+	GcmGammaWidget *gama = (GcmGammaWidget*) object;
+	gcm_gamma_widget_remove_tick (gama);
+	gcm_gamma_widget_invalidate_pattern (gama);
 	G_OBJECT_CLASS (gcm_gamma_widget_parent_class)->finalize (object);
 }
 
-static void
-gcm_gamma_widget_draw_lines (GcmGammaWidget *gama, cairo_t *cr)
+static gboolean
+gcm_gamma_widget_tick_cb (GtkWidget *widget, GdkFrameClock *frame_clock, gpointer user_data)
+{
+	gdouble delta;
+	gdouble interval;
+	gint64 now;
+	GcmGammaWidget *gama = GCM_GAMMA_WIDGET (widget);
+	GcmGammaWidgetPrivate *priv = gama->priv;
+
+	/* all the input since the last frame as one change */
+	if (priv->pending_delta != 0.0f) {
+		delta = priv->pending_delta;
+		priv->pending_delta = 0.0f;
+		g_object_set (gama,
+			      "color-red", CLAMP (priv->color_red + delta, 0.0f, 1.0f),
+			      "color-green", CLAMP (priv->color_green + delta, 0.0f, 1.0f),
+			      "color-blue", CLAMP (priv->color_blue + delta, 0.0f, 1.0f),
+			      NULL);
+	}
+	if (priv->pending) {
+		/* how long since the last update, if it was the frame before */
+		now = gdk_frame_clock_get_frame_time (frame_clock);
+		if (priv->last_frame_time != 0) {
+			interval = now - priv->last_frame_time;
+			if (priv->frame_time == 0.0f)
+				priv->frame_time = interval;
+			else
+				priv->frame_time += (interval - priv->frame_time) / 8.0f;
+		}
+		priv->last_frame_time = now;
+
+		priv->pending = FALSE;
+		priv->idle_frames = 0;
+		gcm_gamma_widget_invalidate_box (gama);
+		return G_SOURCE_CONTINUE;
+	}
+
+	/* only frames that follow each other while updating are measured */
+	priv->last_frame_time = 0;
+
+	/* stop waking up every frame once the user has stopped */
+	if (++priv->idle_frames < GCM_GAMMA_WIDGET_IDLE_FRAMES)
+		return G_SOURCE_CONTINUE;
+	priv->tick_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+/**
+ * gcm_gamma_widget_adjust:
+ * @gama: a #GcmGammaWidget
+ * @delta: the amount to add to each channel of the box
+ *
+ * Changes the color of the box in live mode. All the changes made before
+ * the next frame are applied together, as one change of the color-red,
+ * color-green and color-blue properties.
+ **/
+void
+gcm_gamma_widget_adjust (GcmGammaWidget *gama, gdouble delta)
+{
+	g_return_if_fail (GCM_IS_GAMMA_WIDGET (gama));
+	g_return_if_fail (gama->priv->live);
+	gama->priv->pending_delta += delta;
+	gcm_gamma_widget_ensure_tick (gama);
+}
+
+static gboolean
+gcm_gamma_widget_key_press_event (GtkWidget *widget, GdkEventKey *event)
+{
+	GcmGammaWidget *gama = GCM_GAMMA_WIDGET (widget);
+
+	if (!gama->priv->live)
+		return FALSE;
+	switch (event->keyval) {
+	case GDK_KEY_Up:
+	case GDK_KEY_Right:
+		gcm_gamma_widget_adjust (gama, GCM_GAMMA_WIDGET_STEP);
+		return TRUE;
+	case GDK_KEY_Down:
+	case GDK_KEY_Left:
+		gcm_gamma_widget_adjust (gama, -GCM_GAMMA_WIDGET_STEP);
+		return TRUE;
+	case GDK_KEY_Page_Up:
+		gcm_gamma_widget_adjust (gama, GCM_GAMMA_WIDGET_STEP * 10);
+		return TRUE;
+	case GDK_KEY_Page_Down:
+		gcm_gamma_widget_adjust (gama, -GCM_GAMMA_WIDGET_STEP * 10);
+		return TRUE;
+	default:
+		break;
+	}
+	return FALSE;
+}
+
+static gboolean
+gcm_gamma_widget_scroll_event (GtkWidget *widget, GdkEventScroll *event)
+{
+	GcmGammaWidget *gama = GCM_GAMMA_WIDGET (widget);
+
+	if (!gama->priv->live)
+		return FALSE;
+	switch (event->direction) {
+	case GDK_SCROLL_UP:
+		gcm_gamma_widget_adjust (gama, GCM_GAMMA_WIDGET_STEP);
+		break;
+	case GDK_SCROLL_DOWN:
+		gcm_gamma_widget_adjust (gama, -GCM_GAMMA_WIDGET_STEP);
+		break;
+	case GDK_SCROLL_SMOOTH:
+		gcm_gamma_widget_adjust (gama, -event->delta_y * GCM_GAMMA_WIDGET_STEP);
+		break;
+	default:
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+gcm_gamma_widget_button_press_event (GtkWidget *widget, GdkEventButton *event)
 {
-	guint i;
+	GcmGammaWidget *gama = GCM_GAMMA_WIDGET (widget);
+
+	/* so the keys work */
+	if (!gama->priv->live)
+		return FALSE;
+	gtk_widget_grab_focus (widget);
+	return TRUE;
+}
+
+static cairo_pattern_t *
+gcm_gamma_widget_get_pattern (GcmGammaWidget *gama)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
 	gdouble dark;
 	gdouble light;
 
+	if (gama->priv->pattern != NULL)
+		return gama->priv->pattern;
+
 	/* just copy */
 	dark = gama->priv->color_dark;
 	light = gama->priv->color_light;
 
-	cairo_save (cr);
-	cairo_set_line_width (cr, 1);
-
-	/* do horizontal lines */
-	for (i = 0; i < gama->priv->chart_height; i++) {
-
-		/* set correct color */
-		if (i%2 == 0) {
-			cairo_set_source_rgb (cr, dark, dark, dark);
-		} else {
-			cairo_set_source_rgb (cr, light, light, light);
-		}
-		cairo_move_to (cr, 0.5, i + 0.5f);
-		cairo_line_to (cr, gama->priv->chart_width - 1, i + 0.5f);
-		cairo_stroke (cr);
-	}
+	/* a dark line above a light line */
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 1, 2);
+	cr = cairo_create (surface);
+	cairo_set_source_rgb (cr, dark, dark, dark);
+	cairo_rectangle (cr, 0, 0, 1, 1);
+	cairo_fill (cr);
+	cairo_set_source_rgb (cr, light, light, light);
+	cairo_rectangle (cr, 0, 1, 1, 1);
+	cairo_fill (cr);
+	cairo_destroy (cr);
+
+	/* tiled without any blending between the lines */
+	gama->priv->pattern = cairo_pattern_create_for_surface (surface);
+	cairo_pattern_set_extend (gama->priv->pattern, CAIRO_EXTEND_REPEAT);
+	cairo_pattern_set_filter (gama->priv->pattern, CAIRO_FILTER_NEAREST);
+	cairo_surface_destroy (surface);
+	return gama->priv->pattern;
+}
 
+static void
+gcm_gamma_widget_draw_lines (GcmGammaWidget *gama, cairo_t *cr)
+{
+	/* do horizontal lines, inside the outline of the bounding box */
+	cairo_save (cr);
+	cairo_set_source (cr, gcm_gamma_widget_get_pattern (gama));
+	cairo_rectangle (cr, 1, 1, gama->priv->chart_width - 2, gama->priv->chart_height - 2);
+	cairo_fill (cr);
 	cairo_restore (cr);
 }
 
 static void
 gcm_gamma_widget_draw_box (GcmGammaWidget *gama, cairo_t *cr)
 {
-	guint box_width;
-	guint box_height;
-	guint mid_x;
-	guint mid_y;
+	cairo_rectangle_int_t box;
 
 	cairo_save (cr);
 	cairo_set_line_width (cr, 1);
 
-	/* half the size in either direction */
-	box_width = gama->priv->chart_width / 4;
-	box_height = gama->priv->chart_height / 4;
-	mid_x = gama->priv->chart_width / 2;
-	mid_y = gama->priv->chart_height / 2;
-
 	/* plain box */
+	gcm_gamma_widget_get_box (gama, &box);
 	cairo_set_source_rgb (cr, gama->priv->color_red, gama->priv->color_green, gama->priv->color_blue);
-	cairo_rectangle (cr, mid_x - box_width + 0.5f, (((mid_y - box_height)/2)*2) + 0.0f, box_width*2 + 0.5f, (((box_height*2)/2)*2) + 1.0f);
+	cairo_rectangle (cr, box.x + 0.5f, box.y + 0.0f, box.width + 0.5f, box.height + 1.0f);
 	cairo_fill (cr);
 
 	cairo_restore (cr);
@@ -33,3 +33,5 @@ struct GcmGammaWidgetClass
 
 GType		 gcm_gamma_widget_get_type		(void);
 GtkWidget	*gcm_gamma_widget_new			(void);
+void		 gcm_gamma_widget_adjust		(GcmGammaWidget		*gama,
+							 gdouble		 delta);
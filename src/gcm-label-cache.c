@@ -0,0 +1,196 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "gcm-label-cache.h"
+
+#define GCM_LABEL_CACHE_MAX	256	/* labels, for axes that zoom */
+
+struct GcmLabelCache
+{
+	PangoLayout		*layout;
+	GHashTable		*labels;	/* text -> GcmLabelCacheItem */
+	GQueue			 order;		/* of the items, most recently used first */
+	guint			 max_size;
+	gdouble			 scale;		/* device scale of the labels */
+};
+
+typedef struct {
+	const gchar		*text;		/* owned by the hash table */
+	GList			 link;		/* in the order queue */
+	cairo_surface_t		*surface;
+	gint			 width;
+	gint			 height;
+} GcmLabelCacheItem;
+
+static void
+gcm_label_cache_item_free (GcmLabelCacheItem *item)
+{
+	cairo_surface_destroy (item->surface);
+	g_free (item);
+}
+
+static void
+gcm_label_cache_evict (GcmLabelCache *cache)
+{
+	GcmLabelCacheItem *item = g_queue_peek_tail (&cache->order);
+	g_queue_unlink (&cache->order, &item->link);
+	g_hash_table_remove (cache->labels, item->text);
+}
+
+/**
+ * gcm_label_cache_new:
+ * @layout: the #PangoLayout with the font to use
+ *
+ * Creates a cache of rendered text, so that labels that are drawn on every
+ * redraw only have to be laid out once.
+ *
+ * Return value: a new #GcmLabelCache
+ **/
+GcmLabelCache *
+gcm_label_cache_new (PangoLayout *layout)
+{
+	GcmLabelCache *cache = g_new0 (GcmLabelCache, 1);
+	cache->layout = g_object_ref (layout);
+	cache->labels = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+					       (GDestroyNotify) gcm_label_cache_item_free);
+	g_queue_init (&cache->order);
+	cache->max_size = GCM_LABEL_CACHE_MAX;
+	cache->scale = 1.0f;
+	return cache;
+}
+
+void
+gcm_label_cache_free (GcmLabelCache *cache)
+{
+	g_object_unref (cache->layout);
+	g_hash_table_unref (cache->labels);
+	g_free (cache);
+}
+
+/**
+ * gcm_label_cache_invalidate:
+ * @cache: a #GcmLabelCache
+ *
+ * Drops all the rendered labels, for instance when the font has changed.
+ **/
+void
+gcm_label_cache_invalidate (GcmLabelCache *cache)
+{
+	g_hash_table_remove_all (cache->labels);
+	g_queue_init (&cache->order);
+}
+
+/**
+ * gcm_label_cache_set_max_size:
+ * @cache: a #GcmLabelCache
+ * @max_size: the most labels to keep
+ *
+ * Limits the number of labels, dropping the least recently painted first.
+ **/
+void
+gcm_label_cache_set_max_size (GcmLabelCache *cache, guint max_size)
+{
+	g_return_if_fail (max_size > 0);
+	cache->max_size = max_size;
+	while (g_queue_get_length (&cache->order) > cache->max_size)
+		gcm_label_cache_evict (cache);
+}
+
+gboolean
+gcm_label_cache_has_label (GcmLabelCache *cache, const gchar *text)
+{
+	return g_hash_table_contains (cache->labels, text);
+}
+
+guint
+gcm_label_cache_get_size (GcmLabelCache *cache)
+{
+	return g_hash_table_size (cache->labels);
+}
+
+static GcmLabelCacheItem *
+gcm_label_cache_item_new (GcmLabelCache *cache, const gchar *text)
+{
+	GcmLabelCacheItem *item;
+	PangoRectangle rect;
+	cairo_t *cr;
+
+	pango_layout_set_text (cache->layout, text, -1);
+	pango_layout_get_pixel_extents (cache->layout, NULL, &rect);
+
+	/* render at the device resolution so it stays sharp */
+	item = g_new0 (GcmLabelCacheItem, 1);
+	item->link.data = item;
+	item->width = rect.width;
+	item->height = rect.height;
+	item->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+						    ceil (rect.width * cache->scale),
+						    ceil (rect.height * cache->scale));
+	cairo_surface_set_device_scale (item->surface, cache->scale, cache->scale);
+	cr = cairo_create (item->surface);
+	cairo_set_source_rgb (cr, 0.1, 0.1, 0.1);
+	cairo_move_to (cr, -rect.x, -rect.y);
+	pango_cairo_show_layout (cr, cache->layout);
+	cairo_destroy (cr);
+	return item;
+}
+
+/**
+ * gcm_label_cache_paint:
+ * @cache: a #GcmLabelCache
+ * @cr: a #cairo_t
+ * @text: the label text
+ * @x: the user space x coordinate
+ * @y: the user space y coordinate
+ * @xalign: 0.0 for the left of the label at @x, 1.0 for the right
+ * @yalign: 0.0 for the top of the label at @y, 1.0 for the bottom
+ *
+ * Draws a label, laying it out only if it has not been drawn before at
+ * this device scale.
+ **/
+void
+gcm_label_cache_paint (GcmLabelCache *cache,
+		       cairo_t *cr,
+		       const gchar *text,
+		       gdouble x,
+		       gdouble y,
+		       gdouble xalign,
+		       gdouble yalign)
+{
+	GcmLabelCacheItem *item;
+	gdouble scale_x, scale_y;
+
+	/* moved to a screen with a different scale */
+	cairo_surface_get_device_scale (cairo_get_target (cr), &scale_x, &scale_y);
+	if (scale_x != cache->scale) {
+		gcm_label_cache_invalidate (cache);
+		cache->scale = scale_x;
+	}
+
+	item = g_hash_table_lookup (cache->labels, text);
+	if (item == NULL) {
+		if (g_queue_get_length (&cache->order) >= cache->max_size)
+			gcm_label_cache_evict (cache);
+		item = gcm_label_cache_item_new (cache, text);
+		item->text = g_strdup (text);
+		g_hash_table_insert (cache->labels, (gchar *) item->text, item);
+	} else {
+		g_queue_unlink (&cache->order, &item->link);
+	}
+	g_queue_push_head_link (&cache->order, &item->link);
+
+	/* on whole pixels, so the blit is not filtered */
+	cairo_save (cr);
+	cairo_set_source_surface (cr, item->surface,
+				  floor (x - xalign * item->width + 0.5f),
+				  floor (y - yalign * item->height + 0.5f));
+	cairo_paint (cr);
+	cairo_restore (cr);
+}
@@ -0,0 +1,28 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2006-2010 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: GPL-2.0+
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+typedef struct GcmLabelCache		GcmLabelCache;
+
+GcmLabelCache	*gcm_label_cache_new			(PangoLayout		*layout);
+void		 gcm_label_cache_free			(GcmLabelCache		*cache);
+void		 gcm_label_cache_invalidate		(GcmLabelCache		*cache);
+guint		 gcm_label_cache_get_size		(GcmLabelCache		*cache);
+void		 gcm_label_cache_set_max_size		(GcmLabelCache		*cache,
+							 guint			 max_size);
+gboolean	 gcm_label_cache_has_label		(GcmLabelCache		*cache,
+							 const gchar		*text);
+void		 gcm_label_cache_paint			(GcmLabelCache		*cache,
+							 cairo_t		*cr,
+							 const gchar		*text,
+							 gdouble		 x,
+							 gdouble		 y,
+							 gdouble		 xalign,
+							 gdouble		 yalign);
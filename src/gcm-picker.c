@@ -18,6 +18,7 @@
 #include <lcms2.h>
 #include <colord.h>
 
+#include "gcm-cct.h"
 #include "gcm-utils.h"
 #include "gcm-debug.h"
 
@@ -168,7 +169,7 @@ gcm_picker_refresh_results (GcmPickerPrivate *priv)
 	gtk_label_set_label (label, text_whitepoint);
 
 	/* set temperature */
-	ret = cmsTempFromWhitePoint (&temperature, &xyY);
+	ret = gcm_cct_from_xy (xyY.x, xyY.y, &temperature);
 	if (ret) {
 		/* round to nearest 10K */
 		temperature = (((guint) temperature) / 10) * 10;
@@ -10,11 +10,14 @@
 #include <glib-object.h>
 #include <math.h>
 #include <glib/gstdio.h>
+#include <lcms2.h>
 #include <stdlib.h>
 
+#include "gcm-cct.h"
 #include "gcm-cie-widget.h"
 #include "gcm-debug.h"
 #include "gcm-gamma-widget.h"
+#include "gcm-label-cache.h"
 #include "gcm-trc-widget.h"
 #include "gcm-utils.h"
 
@@ -82,6 +85,815 @@ gcm_test_cie_widget_func (void)
 	gtk_widget_destroy (dialog);
 }
 
+/* Rec. 709 primaries with a D65 white point, as used by sRGB */
+static const CdColorYxy rec709_red = { 1.0, 0.64, 0.33 };
+static const CdColorYxy rec709_green = { 1.0, 0.30, 0.60 };
+static const CdColorYxy rec709_blue = { 1.0, 0.15, 0.06 };
+static const CdColorYxy rec709_white = { 1.0, 0.3127, 0.3291 };
+
+/* the original per-pixel conversion, rebuilding the matrix each time */
+static void
+gcm_test_cie_xyz_to_rgb (const CdColorYxy *red, const CdColorYxy *green,
+			 const CdColorYxy *blue, const CdColorYxy *white,
+			 gdouble xc, gdouble yc, gdouble zc,
+			 gdouble *r, gdouble *g, gdouble *b)
+{
+	gdouble xr, yr, zr, xg, yg, zg, xb, yb, zb;
+	gdouble xw, yw, zw;
+	gdouble rx, ry, rz, gx, gy, gz, bx, by, bz;
+	gdouble rw, gw, bw;
+
+	xr = red->x; yr = red->y; zr = 1 - (xr + yr);
+	xg = green->x; yg = green->y; zg = 1 - (xg + yg);
+	xb = blue->x; yb = blue->y; zb = 1 - (xb + yb);
+	xw = white->x; yw = white->y; zw = 1 - (xw + yw);
+	rx = yg*zb - yb*zg; ry = xb*zg - xg*zb; rz = xg*yb - xb*yg;
+	gx = yb*zr - yr*zb; gy = xr*zb - xb*zr; gz = xb*yr - xr*yb;
+	bx = yr*zg - yg*zr; by = xg*zr - xr*zg; bz = xr*yg - xg*yr;
+	rw = (rx*xw + ry*yw + rz*zw) / yw;
+	gw = (gx*xw + gy*yw + gz*zw) / yw;
+	bw = (bx*xw + by*yw + bz*zw) / yw;
+	*r = (rx*xc + ry*yc + rz*zc) / rw;
+	*g = (gx*xc + gy*yc + gz*zc) / gw;
+	*b = (bx*xc + by*yc + bz*zc) / bw;
+}
+
+static void
+gcm_test_cie_widget_overlay_func (void)
+{
+	GdkRGBA color = { 1.0, 0.0, 0.0, 1.0 };
+	GtkWidget *widget;
+	gboolean ret;
+	guint id1, id2;
+	g_autoptr(CdIcc) profile = NULL;
+	g_autoptr(GFile) file = NULL;
+
+	widget = gcm_cie_widget_new ();
+	g_object_ref_sink (widget);
+	profile = cd_icc_new ();
+	file = g_file_new_for_path (TESTDATADIR "/ibm-t61.icc");
+	ret = cd_icc_load_file (profile, file, CD_ICC_LOAD_FLAGS_NONE, NULL, NULL);
+	g_assert (ret);
+
+	/* each overlay gets its own ID */
+	id1 = gcm_cie_widget_add_overlay (widget, profile, &color,
+					  GCM_CIE_OVERLAY_STYLE_SOLID);
+	id2 = gcm_cie_widget_add_overlay (widget, profile, &color,
+					  GCM_CIE_OVERLAY_STYLE_DASHED);
+	g_assert_cmpint (id1, !=, 0);
+	g_assert_cmpint (id1, !=, id2);
+
+	/* can only be removed once */
+	g_assert (gcm_cie_widget_remove_overlay (widget, id1));
+	g_assert (!gcm_cie_widget_remove_overlay (widget, id1));
+	gcm_cie_widget_clear_overlays (widget);
+	g_assert (!gcm_cie_widget_remove_overlay (widget, id2));
+	g_object_unref (widget);
+}
+
+static void
+gcm_test_cie_render_func (void)
+{
+	GcmCieColorSystem cs;
+	const guint width = 600;
+	guint32 span[600];
+	gdouble dcx = 1.0 / (width - 1);
+	guint i, j, k;
+
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	for (j = 0; j < 85; j++) {
+		gdouble cy = j / 100.0;
+		gcm_cie_render_span (&cs, 0.0, dcx, cy, span, width);
+		for (i = 0; i < width; i++) {
+			gdouble cx = i * dcx;
+			gdouble r, g, b;
+			gdouble r2, g2, b2;
+			guint32 pixel;
+
+			/* the cached matrix has to match the original */
+			gcm_test_cie_xyz_to_rgb (&rec709_red, &rec709_green,
+						 &rec709_blue, &rec709_white,
+						 cx, cy, 1.0 - (cx + cy), &r, &g, &b);
+			gcm_cie_color_system_xyz_to_rgb (&cs, cx, cy, 1.0 - (cx + cy),
+							 &r2, &g2, &b2);
+			g_assert_cmpfloat (fabs (r - r2), <, 1e-9);
+			g_assert_cmpfloat (fabs (g - g2), <, 1e-9);
+			g_assert_cmpfloat (fabs (b - b2), <, 1e-9);
+
+			/* and the incremental span has to match per-pixel */
+			pixel = gcm_cie_color_system_to_pixel (&cs, r, g, b);
+			for (k = 0; k < 32; k += 8) {
+				gint c1 = (pixel >> k) & 0xff;
+				gint c2 = (span[i] >> k) & 0xff;
+				g_assert_cmpint (ABS (c1 - c2), <=, 1);
+			}
+		}
+	}
+}
+
+static void
+gcm_test_cie_render_transfer_func (void)
+{
+	GcmCieColorSystem cs;
+	guint i;
+
+	/* the interpolated table has to be good enough for 8 bit output */
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	for (i = 0; i <= 1000; i++) {
+		gdouble c = i / 1000.0;
+		gdouble expected = c < 0.018 ? c * 4.5 : 1.099 * pow (c, 0.45) - 0.099;
+		g_assert_cmpfloat (fabs (gcm_cie_color_system_transfer (&cs, c) - expected), <, 0.5 / 255);
+	}
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_SRGB, 0.0);
+	for (i = 0; i <= 1000; i++) {
+		gdouble c = i / 1000.0;
+		gdouble expected = c <= 0.0031308 ? c * 12.92 : 1.055 * pow (c, 1 / 2.4) - 0.055;
+		g_assert_cmpfloat (fabs (gcm_cie_color_system_transfer (&cs, c) - expected), <, 0.5 / 255);
+	}
+}
+
+static void
+gcm_test_cie_render_kernels_func (void)
+{
+	GcmCieColorSystem cs;
+	GcmCieRenderKernel kernel;
+	GcmCieRenderSpanFunc func;
+	GcmCieRenderSpanFunc scalar;
+	const guint width = 603;
+	guint32 expected[603];
+	guint32 span[603];
+	gdouble dcx = 1.0 / (width - 1);
+	guint i, j, k;
+
+	/* every vectorized kernel has to match the scalar reference */
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	scalar = gcm_cie_render_get_span_func (GCM_CIE_RENDER_KERNEL_SCALAR);
+	for (kernel = GCM_CIE_RENDER_KERNEL_SCALAR + 1; kernel < GCM_CIE_RENDER_KERNEL_LAST; kernel++) {
+		func = gcm_cie_render_get_span_func (kernel);
+		if (func == NULL) {
+			g_test_message ("%s not supported", gcm_cie_render_kernel_to_string (kernel));
+			continue;
+		}
+		for (j = 0; j < 85; j++) {
+			scalar (&cs, 0.0, dcx, j / 100.0, expected, width);
+			func (&cs, 0.0, dcx, j / 100.0, span, width);
+			for (i = 0; i < width; i++) {
+				for (k = 0; k < 32; k += 8) {
+					gint c1 = (expected[i] >> k) & 0xff;
+					gint c2 = (span[i] >> k) & 0xff;
+					g_assert_cmpint (ABS (c1 - c2), <=, 1);
+				}
+			}
+		}
+	}
+}
+
+static void
+gcm_test_cie_render_tongue_func (void)
+{
+	GcmCieColorSystem cs;
+	GcmCieMapping map = { 0.0, 1.0, 1.0 / 99, -1.0 / 99 };
+	GcmCieSpan spans[100];
+	guint32 whole[100][100];
+	guint32 strips[100][100];
+	guint32 expected[100];
+	guint i, y;
+
+	/* a diamond, with some empty rows */
+	for (y = 0; y < 100; y++) {
+		spans[y].min = ABS (50 - (gint) y);
+		spans[y].max = 100 - ABS (50 - (gint) y);
+	}
+	spans[0].min = spans[0].max = 0;
+	spans[99].min = 7;
+	spans[99].max = 3;
+
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	memset (whole, 0, sizeof (whole));
+	gcm_cie_render_tongue (&cs, &map, spans, 0, 100,
+			       (guchar *) whole, sizeof (whole[0]));
+
+	/* rendering in strips has to give the same result */
+	memset (strips, 0, sizeof (strips));
+	for (y = 0; y < 100; y += 33) {
+		gcm_cie_render_tongue (&cs, &map, spans, y, MIN (33, 100 - y),
+				       (guchar *) strips[y], sizeof (strips[0]));
+	}
+	g_assert_cmpint (memcmp (whole, strips, sizeof (whole)), ==, 0);
+
+	/* only the spans are touched */
+	for (y = 0; y < 100; y++) {
+		memset (expected, 0, sizeof (expected));
+		if (spans[y].max > spans[y].min) {
+			gcm_cie_render_span (&cs,
+					     map.cx + spans[y].min * map.dcx,
+					     map.dcx,
+					     map.cy + y * map.dcy,
+					     expected + spans[y].min,
+					     spans[y].max - spans[y].min);
+		}
+		for (i = 0; i < 100; i++)
+			g_assert_cmpuint (whole[y][i], ==, expected[i]);
+	}
+}
+
+static void
+gcm_test_cie_render_scan_func (void)
+{
+	const gdouble square[][2] = {
+		{ 0.2, 0.2 }, { 0.8, 0.2 }, { 0.8, 0.8 }, { 0.2, 0.8 } };
+	const gdouble triangle[][2] = {
+		{ 0.5, 0.9 }, { 0.9, 0.1 }, { 0.1, 0.1 }, { 0.1, 0.1 } };
+	GcmCieMapping map = { 0.0, 1.0, 0.01, -0.01 };
+	GcmCieSpan spans[100];
+	guint y;
+
+	/* pixel centres 20.5..79.5 are inside */
+	gcm_cie_render_scan_polygon (square[0], 4, &map, spans, 100, 100);
+	for (y = 0; y < 100; y++) {
+		if (y < 20 || y >= 80) {
+			g_assert_cmpint (spans[y].min, ==, 0);
+			g_assert_cmpint (spans[y].max, ==, 0);
+			continue;
+		}
+		g_assert_cmpint (spans[y].min, ==, 20);
+		g_assert_cmpint (spans[y].max, ==, 80);
+	}
+
+	/* no gaps below the apex, with a repeated point and clipped */
+	gcm_cie_render_scan_polygon (triangle[0], 4, &map, spans, 60, 100);
+	for (y = 11; y < 90; y++) {
+		g_assert_cmpint (spans[y].min, <, spans[y].max);
+		g_assert_cmpint (spans[y].max, <=, 60);
+	}
+	g_assert_cmpint (spans[9].max, ==, 0);
+	g_assert_cmpint (spans[50].min, ==, 30);
+	g_assert_cmpint (spans[89].min, ==, 10);
+}
+
+static guint32
+gcm_test_cie_surface_get_pixel (cairo_surface_t *surface, const GcmCieMapping *map,
+				gdouble x, gdouble y)
+{
+	guchar *data = cairo_image_surface_get_data (surface);
+	gint stride = cairo_image_surface_get_stride (surface);
+	gint px = (x - map->cx) / map->dcx;
+	gint py = (y - map->cy) / map->dcy;
+	return *(guint32 *) (data + py * stride + px * 4);
+}
+
+static void
+gcm_test_cie_render_mesh_func (void)
+{
+	GcmCieColorSystem cs;
+	GcmCieMapping map = { 0.0, 1.0, 1.0 / 399, -1.0 / 399 };
+	GcmCieSpan spans[400];
+	cairo_pattern_t *mesh;
+	cairo_surface_t *mesh_surface;
+	cairo_surface_t *raster_surface;
+	cairo_t *cr;
+	const gdouble *locus;
+	guint32 pixel_mesh;
+	guint32 pixel_raster;
+	guint i, j;
+	guint n_points;
+	const gdouble inside[] = { 0.3127, 0.3291,
+				   0.30, 0.50,
+				   0.25, 0.25,
+				   0.45, 0.40,
+				   0.20, 0.60,
+				   0.50, 0.30 };
+	const gdouble outside[] = { 0.05, 0.05,
+				    0.60, 0.10,
+				    0.70, 0.70,
+				    0.02, 0.60 };
+
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+
+	/* the exact colors */
+	raster_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 400, 400);
+	cairo_surface_flush (raster_surface);
+	locus = gcm_cie_render_get_locus (&n_points);
+	gcm_cie_render_scan_polygon (locus, n_points, &map, spans, 400, 400);
+	gcm_cie_render_tongue (&cs, &map, spans, 0, 400,
+			       cairo_image_surface_get_data (raster_surface),
+			       cairo_image_surface_get_stride (raster_surface));
+	cairo_surface_mark_dirty (raster_surface);
+
+	/* the interpolated ones */
+	mesh = gcm_cie_render_create_mesh (&cs, 48);
+	mesh_surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 400, 400);
+	cr = cairo_create (mesh_surface);
+	gcm_cie_render_paint_mesh (cr, mesh, &map);
+	cairo_destroy (cr);
+	cairo_surface_flush (mesh_surface);
+
+	/* close to each other away from the edges */
+	for (i = 0; i < G_N_ELEMENTS (inside); i += 2) {
+		pixel_raster = gcm_test_cie_surface_get_pixel (raster_surface, &map,
+								inside[i], inside[i + 1]);
+		pixel_mesh = gcm_test_cie_surface_get_pixel (mesh_surface, &map,
+							      inside[i], inside[i + 1]);
+		g_assert_cmpuint (pixel_mesh >> 24, ==, 0xff);
+		for (j = 0; j < 24; j += 8) {
+			gint diff = (gint) ((pixel_mesh >> j) & 0xff) -
+				    (gint) ((pixel_raster >> j) & 0xff);
+			g_assert_cmpint (ABS (diff), <=, 12);
+		}
+	}
+
+	/* and nothing is painted outside the locus */
+	for (i = 0; i < G_N_ELEMENTS (outside); i += 2) {
+		pixel_mesh = gcm_test_cie_surface_get_pixel (mesh_surface, &map,
+							      outside[i], outside[i + 1]);
+		g_assert_cmpuint (pixel_mesh, ==, 0);
+	}
+
+	cairo_pattern_destroy (mesh);
+	cairo_surface_destroy (mesh_surface);
+	cairo_surface_destroy (raster_surface);
+}
+
+static void
+gcm_test_cie_render_hue_func (void)
+{
+	GcmCieHueTable table;
+	gboolean ret;
+	gdouble wavelength;
+	gdouble x, y;
+
+	gcm_cie_hue_table_init (&table, &rec709_white);
+
+	/* on the locus itself */
+	gcm_cie_render_get_spectral_chromaticity (550, &x, &y);
+	ret = gcm_cie_hue_table_lookup (&table, x, y, &wavelength);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (wavelength - 550), <, 0.5);
+
+	/* halfway from the white point */
+	gcm_cie_render_get_spectral_chromaticity (600, &x, &y);
+	ret = gcm_cie_hue_table_lookup (&table,
+					(x + rec709_white.x) / 2,
+					(y + rec709_white.y) / 2,
+					&wavelength);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (wavelength - 600), <, 0.5);
+
+	/* a purple has a green complementary */
+	ret = gcm_cie_hue_table_lookup (&table, 0.35, 0.15, &wavelength);
+	g_assert_false (ret);
+	g_assert_cmpfloat (wavelength, >, 490);
+	g_assert_cmpfloat (wavelength, <, 570);
+
+	/* inside the sRGB triangle */
+	g_assert_true (gcm_cie_render_in_gamut (&rec709_red, &rec709_green, &rec709_blue,
+						rec709_white.x, rec709_white.y));
+	g_assert_true (gcm_cie_render_in_gamut (&rec709_blue, &rec709_green, &rec709_red, 0.3, 0.3));
+	g_assert_false (gcm_cie_render_in_gamut (&rec709_red, &rec709_green, &rec709_blue, 0.1, 0.7));
+	g_assert_false (gcm_cie_render_in_gamut (&rec709_red, &rec709_green, &rec709_blue, 0.7, 0.3));
+}
+
+static void
+gcm_test_cie_render_profile_func (void)
+{
+	GcmCieRenderParams params;
+	cairo_surface_t *surface;
+	cmsHPROFILE profile;
+	cmsHTRANSFORM transform;
+	gboolean ret;
+	guint32 *data;
+	guint i, j;
+	const guint32 colors[] = { 0xff808080, 0xffc04020, 0xff20c040 };
+	g_autoptr(CdIcc) icc = cd_icc_new ();
+	g_autoptr(GError) error = NULL;
+
+	/* an sRGB diagram shown on an sRGB display */
+	ret = cd_icc_create_default (icc, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	gcm_cie_render_params_init (&params);
+	params.transfer = GCM_CIE_TRANSFER_SRGB;
+	profile = gcm_cie_render_create_profile (&params);
+	transform = gcm_utils_create_display_transform (profile, icc);
+	g_assert (transform != NULL);
+	cmsCloseProfile (profile);
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, 3, 1);
+	data = (guint32 *) cairo_image_surface_get_data (surface);
+	for (i = 0; i < 3; i++)
+		data[i] = colors[i];
+	cairo_surface_mark_dirty (surface);
+	gcm_utils_transform_surface (transform, surface);
+
+	/* so nothing should have changed */
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 24; j += 8) {
+			gint diff = (gint) ((data[i] >> j) & 0xff) - (gint) ((colors[i] >> j) & 0xff);
+			g_assert_cmpint (ABS (diff), <=, 2);
+		}
+	}
+	cmsDeleteTransform (transform);
+	cairo_surface_destroy (surface);
+}
+
+static void
+gcm_test_cie_render_export_func (void)
+{
+	GcmCieRenderParams params;
+	GcmCieMapping map;
+	cairo_surface_t *png;
+	cairo_surface_t *surface;
+	gboolean ret;
+	gdouble x, y;
+	guint32 pixel;
+	guint i, j;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* no widget or display is needed */
+	gcm_cie_render_params_init (&params);
+	surface = gcm_cie_render_to_surface (&params, 300, 301, 1);
+	g_assert_cmpint (cairo_image_surface_get_width (surface), ==, 300);
+	g_assert_cmpint (cairo_image_surface_get_height (surface), ==, 301);
+
+	/* green is inside the tongue, the corner is outside */
+	gcm_cie_render_get_mapping (300, 301, &map);
+	gcm_cie_render_map_to_display (&map, 0.2, 0.6, &x, &y);
+	cairo_surface_flush (surface);
+	pixel = ((guint32 *) (cairo_image_surface_get_data (surface) +
+			      (gint) y * cairo_image_surface_get_stride (surface)))[(gint) x];
+	g_assert_cmpint ((pixel >> 8) & 0xff, >, (pixel >> 16) & 0xff);
+	pixel = ((guint32 *) (cairo_image_surface_get_data (surface) +
+			      3 * cairo_image_surface_get_stride (surface)))[296];
+	g_assert_cmphex (pixel & 0xffffff, ==, 0xffffff);
+
+	/* writing in strips has to give the same pixels */
+	filename = g_build_filename (g_get_tmp_dir (), "gcm-self-test-cie.png", NULL);
+	ret = gcm_cie_render_to_png (&params, 300, 301, filename, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	png = cairo_image_surface_create_from_png (filename);
+	g_assert_cmpint (cairo_surface_status (png), ==, CAIRO_STATUS_SUCCESS);
+	for (j = 0; j < 301; j++) {
+		const guint32 *a = (const guint32 *) (cairo_image_surface_get_data (surface) +
+						      j * cairo_image_surface_get_stride (surface));
+		const guint32 *b = (const guint32 *) (cairo_image_surface_get_data (png) +
+						      j * cairo_image_surface_get_stride (png));
+		for (i = 0; i < 300; i++)
+			g_assert_cmphex (a[i] & 0xffffff, ==, b[i] & 0xffffff);
+	}
+	g_unlink (filename);
+	cairo_surface_destroy (png);
+	cairo_surface_destroy (surface);
+}
+
+static void
+gcm_test_cct_func (void)
+{
+	gboolean ret;
+	gdouble temperature;
+	gdouble x, y;
+
+	/* D65 and illuminant A */
+	ret = gcm_cct_from_xy (0.3127, 0.3290, &temperature);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (temperature - 6504), <, 10);
+	ret = gcm_cct_from_xy (0.44757, 0.40745, &temperature);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (temperature - 2856), <, 5);
+
+	/* back again, on and off the locus */
+	ret = gcm_cct_to_xy (5000, 0.0f, &x, &y);
+	g_assert_true (ret);
+	ret = gcm_cct_from_xy (x, y, &temperature);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (temperature - 5000), <, 2);
+	ret = gcm_cct_to_xy (5000, 0.01f, &x, &y);
+	g_assert_true (ret);
+	ret = gcm_cct_from_xy (x, y, &temperature);
+	g_assert_true (ret);
+	g_assert_cmpfloat (fabs (temperature - 5000), <, 2);
+
+	/* too red */
+	g_assert_false (gcm_cct_to_xy (1000, 0.0f, &x, &y));
+	g_assert_false (gcm_cct_from_xy (0.65, 0.33, &temperature));
+}
+
+static void
+gcm_test_cct_perf_func (void)
+{
+	gdouble temperature;
+	gdouble total = 0.0f;
+	guint i;
+	const guint loops = 1000000;
+
+	g_test_timer_start ();
+	for (i = 0; i < loops; i++) {
+		gcm_cct_from_xy (0.30 + (i % 1000) * 0.0001, 0.32, &temperature);
+		total += temperature;
+	}
+	g_test_minimized_result (g_test_timer_elapsed (),
+				 "%u lookups: %.3fus each",
+				 loops, g_test_timer_last () * 1e6 / loops);
+	g_assert_cmpfloat (total, >, 0);
+}
+
+static void
+gcm_test_label_cache_func (void)
+{
+	GcmLabelCache *cache;
+	PangoLayout *layout;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	layout = pango_layout_new (gdk_pango_context_get ());
+	cache = gcm_label_cache_new (layout);
+	surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 64, 32);
+	cr = cairo_create (surface);
+
+	/* only laid out once */
+	gcm_label_cache_paint (cache, cr, "0.5", 2, 2, 0.0f, 0.0f);
+	gcm_label_cache_paint (cache, cr, "0.5", 30, 2, 0.0f, 0.0f);
+	g_assert_cmpuint (gcm_label_cache_get_size (cache), ==, 1);
+	gcm_label_cache_paint (cache, cr, "520", 2, 30, 0.0f, 1.0f);
+	g_assert_cmpuint (gcm_label_cache_get_size (cache), ==, 2);
+	cairo_destroy (cr);
+
+	/* laid out again for a HiDPI target */
+	cairo_surface_set_device_scale (surface, 2, 2);
+	cr = cairo_create (surface);
+	gcm_label_cache_paint (cache, cr, "0.5", 2, 2, 0.0f, 0.0f);
+	g_assert_cmpuint (gcm_label_cache_get_size (cache), ==, 1);
+	cairo_destroy (cr);
+
+	/* only the least recently painted is dropped */
+	gcm_label_cache_set_max_size (cache, 2);
+	cr = cairo_create (surface);
+	gcm_label_cache_paint (cache, cr, "0.1", 2, 2, 0.0f, 0.0f);
+	gcm_label_cache_paint (cache, cr, "0.2", 2, 2, 0.0f, 0.0f);
+	gcm_label_cache_paint (cache, cr, "0.1", 2, 2, 0.0f, 0.0f);
+	gcm_label_cache_paint (cache, cr, "0.3", 2, 2, 0.0f, 0.0f);
+	g_assert_cmpuint (gcm_label_cache_get_size (cache), ==, 2);
+	g_assert_true (gcm_label_cache_has_label (cache, "0.1"));
+	g_assert_false (gcm_label_cache_has_label (cache, "0.2"));
+	g_assert_true (gcm_label_cache_has_label (cache, "0.3"));
+	cairo_destroy (cr);
+
+	gcm_label_cache_invalidate (cache);
+	g_assert_cmpuint (gcm_label_cache_get_size (cache), ==, 0);
+	gcm_label_cache_free (cache);
+	g_object_unref (layout);
+	cairo_surface_destroy (surface);
+}
+
+static void
+gcm_test_cie_histogram_func (void)
+{
+	CdColorXYZ colors[] = {
+		{ 0.9505, 1.0000, 1.0890 },	/* D65, x=0.3127 y=0.3290 */
+		{ 0.9505, 1.0000, 1.0890 },
+		{ 0.4124, 0.2126, 0.0193 },	/* sRGB red, x=0.64 y=0.33 */
+		{ 0.0, 0.0, 0.0 } };		/* black is ignored */
+	GcmCieHistogram *histogram;
+	cairo_surface_t *heatmap;
+	guint32 *data;
+	gint stride;
+
+	histogram = gcm_cie_histogram_new ();
+	gcm_cie_histogram_add_xyz (histogram, colors, G_N_ELEMENTS (colors));
+	g_assert_cmpint (gcm_cie_histogram_get_total (histogram), ==, 3);
+	g_assert_cmpint (gcm_cie_histogram_get_bin (histogram, 80, 84), ==, 2);
+	g_assert_cmpint (gcm_cie_histogram_get_bin (histogram, 163, 84), ==, 1);
+	g_assert_cmpint (gcm_cie_histogram_get_bin (histogram, 0, 0), ==, 0);
+
+	/* empty bins are transparent, and the busiest is the most opaque */
+	heatmap = gcm_cie_histogram_render (histogram);
+	cairo_surface_flush (heatmap);
+	data = (guint32 *) cairo_image_surface_get_data (heatmap);
+	stride = cairo_image_surface_get_stride (heatmap) / 4;
+	g_assert_cmphex (data[(GCM_CIE_HISTOGRAM_SIZE - 1) * stride], ==, 0);
+	g_assert_cmphex (data[(GCM_CIE_HISTOGRAM_SIZE - 1 - 84) * stride + 80] >> 24, ==, 0xff);
+	g_assert_cmphex (data[(GCM_CIE_HISTOGRAM_SIZE - 1 - 84) * stride + 163] >> 24, <, 0xff);
+	cairo_surface_destroy (heatmap);
+	gcm_cie_histogram_free (histogram);
+}
+
+/* the chromaticity of D50 is x=0.3457 y=0.3585 */
+#define GCM_TEST_HISTOGRAM_D50_X	88
+#define GCM_TEST_HISTOGRAM_D50_Y	91
+
+static void
+gcm_test_cie_histogram_pixbuf_func (void)
+{
+	GcmCieHistogram *histogram;
+	GdkPixbuf *pixbuf;
+	gboolean ret;
+	guint width = 64;
+	guint height = 512;
+	g_autoptr(GError) error = NULL;
+
+	/* tall enough to be split into bands on more than one CPU */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, width, height);
+	gdk_pixbuf_fill (pixbuf, 0xffffffff);
+
+	/* sRGB white lands on the D50 white of the primaries */
+	histogram = gcm_cie_histogram_new ();
+	ret = gcm_cie_histogram_add_pixbuf (histogram, pixbuf, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gcm_cie_histogram_get_total (histogram), ==, width * height);
+	g_assert_cmpint (gcm_cie_histogram_get_bin (histogram,
+						    GCM_TEST_HISTOGRAM_D50_X,
+						    GCM_TEST_HISTOGRAM_D50_Y), ==, width * height);
+	gcm_cie_histogram_free (histogram);
+	g_object_unref (pixbuf);
+}
+
+static void
+gcm_test_cie_histogram_named_func (void)
+{
+	cmsHPROFILE lcms_profile;
+	cmsNAMEDCOLORLIST *nc2;
+	cmsUInt32Number size = 0;
+	GcmCieHistogram *histogram;
+	gboolean ret;
+	cmsUInt16Number white[3] = { 0xffff, 0x8080, 0x8080 };
+	cmsUInt16Number grey[3] = { 0x8000, 0x8080, 0x8080 };
+	cmsUInt16Number black[3] = { 0x0000, 0x8080, 0x8080 };
+	g_autofree guint8 *data = NULL;
+	g_autoptr(CdIcc) profile = cd_icc_new ();
+	g_autoptr(GError) error = NULL;
+
+	/* white and grey share a chromaticity, and black has none */
+	lcms_profile = cmsCreateProfilePlaceholder (NULL);
+	cmsSetDeviceClass (lcms_profile, cmsSigNamedColorClass);
+	cmsSetColorSpace (lcms_profile, cmsSigRgbData);
+	cmsSetPCS (lcms_profile, cmsSigLabData);
+	nc2 = cmsAllocNamedColorList (NULL, 3, 0, "", "");
+	cmsAppendNamedColor (nc2, "white", white, NULL);
+	cmsAppendNamedColor (nc2, "grey", grey, NULL);
+	cmsAppendNamedColor (nc2, "black", black, NULL);
+	cmsWriteTag (lcms_profile, cmsSigNamedColor2Tag, nc2);
+	cmsFreeNamedColorList (nc2);
+	ret = cmsSaveProfileToMem (lcms_profile, NULL, &size);
+	g_assert (ret);
+	data = g_malloc (size);
+	ret = cmsSaveProfileToMem (lcms_profile, data, &size);
+	g_assert (ret);
+	cmsCloseProfile (lcms_profile);
+	ret = cd_icc_load_data (profile, data, size, CD_ICC_LOAD_FLAGS_NAMED_COLORS, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	histogram = gcm_cie_histogram_new ();
+	ret = gcm_cie_histogram_add_named_colors (histogram, profile, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gcm_cie_histogram_get_total (histogram), ==, 2);
+	g_assert_cmpint (gcm_cie_histogram_get_bin (histogram,
+						    GCM_TEST_HISTOGRAM_D50_X,
+						    GCM_TEST_HISTOGRAM_D50_Y), ==, 2);
+	gcm_cie_histogram_free (histogram);
+}
+
+static void
+gcm_test_cie_histogram_perf_func (void)
+{
+	GcmCieHistogram *histogram;
+	GdkPixbuf *pixbuf;
+	gboolean ret;
+	guchar *pixels;
+	gint rowstride;
+	guint width = 8660;
+	guint height = 5773;
+	guint x, y;
+	g_autoptr(GError) error = NULL;
+
+	/* a 50 megapixel sRGB image with lots of different colors */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	for (y = 0; y < height; y++) {
+		guchar *p = pixels + y * rowstride;
+		for (x = 0; x < width; x++) {
+			p[x * 3 + 0] = x;
+			p[x * 3 + 1] = y;
+			p[x * 3 + 2] = x ^ y;
+		}
+	}
+
+	histogram = gcm_cie_histogram_new ();
+	g_test_timer_start ();
+	ret = gcm_cie_histogram_add_pixbuf (histogram, pixbuf, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_test_minimized_result (g_test_timer_elapsed (),
+				 "%ux%u: %.1fms with %u threads",
+				 width, height, g_test_timer_last () * 1000,
+				 g_get_num_processors ());
+	g_assert_cmpfloat (g_test_timer_last (), <, 1.0);
+	g_assert_cmpint (gcm_cie_histogram_get_total (histogram), >, 0);
+	gcm_cie_histogram_free (histogram);
+	g_object_unref (pixbuf);
+}
+
+static void
+gcm_test_cie_render_perf_func (void)
+{
+	GcmCieColorSystem cs;
+	GcmCieRenderKernel kernel;
+	GcmCieRenderSpanFunc func;
+	const guint size = 2048;
+	g_autofree guint32 *span = g_new (guint32, size);
+	guint j;
+
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	for (kernel = GCM_CIE_RENDER_KERNEL_SCALAR; kernel < GCM_CIE_RENDER_KERNEL_LAST; kernel++) {
+		gdouble elapsed;
+		func = gcm_cie_render_get_span_func (kernel);
+		if (func == NULL)
+			continue;
+		g_test_timer_start ();
+		for (j = 0; j < size; j++)
+			func (&cs, 0.0, 1.0 / (size - 1), (gdouble) j / size, span, size);
+		elapsed = g_test_timer_elapsed ();
+		g_test_maximized_result (size * size / elapsed,
+					 "%s: %.1f Mpixels/s",
+					 gcm_cie_render_kernel_to_string (kernel),
+					 size * size / elapsed / 1e6);
+	}
+}
+
+typedef struct {
+	GcmCieColorSystem	*cs;
+	guint32			*data;
+	guint			 width;
+	guint			 height;
+} GcmTestCieRenderHelper;
+
+static void
+gcm_test_cie_render_band_cb (guint start, guint end, gpointer user_data)
+{
+	GcmTestCieRenderHelper *helper = (GcmTestCieRenderHelper *) user_data;
+	guint j;
+	for (j = start; j < end; j++) {
+		gcm_cie_render_span (helper->cs, 0.0, 1.0 / (helper->width - 1),
+				     1.0 - (gdouble) j / helper->height,
+				     helper->data + j * helper->width,
+				     helper->width);
+	}
+}
+
+static void
+gcm_test_cie_render_parallel_perf_func (void)
+{
+	GcmCieColorSystem cs;
+	GcmTestCieRenderHelper helper;
+	gdouble elapsed_serial;
+	gdouble elapsed_parallel;
+	g_autofree guint32 *data = NULL;
+	g_autofree guint32 *data_serial = NULL;
+
+	/* a 4K-class allocation */
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	helper.cs = &cs;
+	helper.width = 3840;
+	helper.height = 2160;
+	data_serial = g_new (guint32, helper.width * helper.height);
+	data = g_new (guint32, helper.width * helper.height);
+
+	helper.data = data_serial;
+	g_test_timer_start ();
+	gcm_test_cie_render_band_cb (0, helper.height, &helper);
+	elapsed_serial = g_test_timer_elapsed ();
+
+	helper.data = data;
+	g_test_timer_start ();
+	gcm_cie_render_parallel (helper.height, 32, gcm_test_cie_render_band_cb, &helper);
+	elapsed_parallel = g_test_timer_elapsed ();
+
+	/* the bands must not overlap or leave gaps */
+	g_assert (memcmp (data, data_serial, helper.width * helper.height * 4) == 0);
+	g_test_minimized_result (elapsed_parallel,
+				 "3840x2160: serial %.1fms, %u threads %.1fms",
+				 elapsed_serial * 1000, g_get_num_processors (),
+				 elapsed_parallel * 1000);
+}
+
 static void
 gcm_test_gamma_widget_func (void)
 {
@@ -120,6 +932,162 @@ gcm_test_gamma_widget_func (void)
 	gtk_widget_destroy (dialog);
 }
 
+static gboolean
+gcm_test_gamma_widget_sweep_cb (gpointer user_data)
+{
+	gdouble delta = 0.001;
+
+	/* much faster than the display refreshes, up then down each second */
+	if ((g_get_monotonic_time () / G_USEC_PER_SEC) % 2 == 1)
+		delta = -delta;
+	gcm_gamma_widget_adjust (GCM_GAMMA_WIDGET (user_data), delta);
+	return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+gcm_test_loop_quit_cb (gpointer user_data)
+{
+	g_main_loop_quit (user_data);
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gcm_test_gamma_widget_notify_cb (GObject *object, GParamSpec *pspec, gpointer user_data)
+{
+	guint *changes = (guint *) user_data;
+	(*changes)++;
+}
+
+static void
+gcm_test_gamma_widget_live_func (void)
+{
+	GtkWidget *widget;
+	GtkWidget *window;
+	gdouble value = 0.0f;
+	guint changes = 0;
+	guint i;
+	guint timeout_id;
+	g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+
+	widget = gcm_gamma_widget_new ();
+	g_object_set (widget, "live", TRUE, NULL);
+	g_signal_connect (widget, "notify::color-red",
+			  G_CALLBACK (gcm_test_gamma_widget_notify_cb), &changes);
+	g_signal_connect_swapped (widget, "notify::color-red",
+				  G_CALLBACK (g_main_loop_quit), loop);
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 300, 300);
+	gtk_container_add (GTK_CONTAINER (window), widget);
+	gtk_widget_show_all (window);
+
+	/* a burst of input before the next frame */
+	for (i = 0; i < 100; i++)
+		gcm_gamma_widget_adjust (GCM_GAMMA_WIDGET (widget), 0.001);
+	g_assert_cmpint (changes, ==, 0);
+
+	/* is one change of color, whenever the first frame arrives */
+	timeout_id = g_timeout_add_seconds (10, gcm_test_loop_quit_cb, loop);
+	g_main_loop_run (loop);
+	g_assert_cmpint (changes, ==, 1);
+	g_source_remove (timeout_id);
+	g_object_get (widget, "color-red", &value, NULL);
+	g_assert_cmpfloat (fabs (value - 0.6f), <, 0.0001);
+	gtk_widget_destroy (window);
+}
+
+static void
+gcm_test_gamma_widget_live_perf_func (void)
+{
+	GtkWidget *widget;
+	GtkWidget *window;
+	gdouble frame_time = 0.0f;
+	guint sweep_id;
+	g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, FALSE);
+
+	widget = gcm_gamma_widget_new ();
+	g_object_set (widget, "live", TRUE, NULL);
+	window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+	gtk_window_set_default_size (GTK_WINDOW (window), 800, 1200);
+	gtk_container_add (GTK_CONTAINER (window), widget);
+	gtk_widget_show_all (window);
+
+	/* sweep for a couple of seconds */
+	sweep_id = g_timeout_add (1, gcm_test_gamma_widget_sweep_cb, widget);
+	g_timeout_add (2000, gcm_test_loop_quit_cb, loop);
+	g_main_loop_run (loop);
+	g_source_remove (sweep_id);
+
+	/* at least 60Hz, allowing for the odd late frame */
+	g_object_get (widget, "frame-time", &frame_time, NULL);
+	g_assert_cmpfloat (frame_time, >, 0.0f);
+	g_assert_cmpfloat (frame_time, <, 1000.0f / 50.0f);
+	g_test_minimized_result (frame_time / 1000.0f,
+				 "live sweep: %.2fms per frame, %.0fHz",
+				 frame_time, 1000.0f / frame_time);
+	gtk_widget_destroy (window);
+}
+
+static void
+gcm_test_cie_render_engine_perf_func (void)
+{
+	const guint sizes[] = { 200, 400, 800, 1600, 3840, 0 };
+	GcmCieColorSystem cs;
+	cairo_pattern_t *mesh;
+	const gdouble *locus;
+	gdouble elapsed_raster;
+	gdouble elapsed_mesh;
+	guint n_points;
+	guint i;
+
+	gcm_cie_color_system_init (&cs, &rec709_red, &rec709_green,
+				   &rec709_blue, &rec709_white);
+	gcm_cie_color_system_set_transfer (&cs, GCM_CIE_TRANSFER_REC709, 0.0);
+	locus = gcm_cie_render_get_locus (&n_points);
+
+	/* the mesh is only built when the primaries change */
+	g_test_timer_start ();
+	mesh = gcm_cie_render_create_mesh (&cs, 48);
+	g_test_minimized_result (g_test_timer_elapsed (), "mesh build %.1fms",
+				 g_test_timer_last () * 1000);
+
+	for (i = 0; sizes[i] != 0; i++) {
+		GcmCieMapping map = { 0.0, 1.0, 1.0 / (sizes[i] - 1), -1.0 / (sizes[i] - 1) };
+		g_autofree GcmCieSpan *spans = g_new (GcmCieSpan, sizes[i]);
+		cairo_surface_t *surface;
+		cairo_t *cr;
+
+		/* raster, which scan converts the locus and fills every pixel */
+		surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, sizes[i], sizes[i]);
+		cairo_surface_flush (surface);
+		g_test_timer_start ();
+		gcm_cie_render_scan_polygon (locus, n_points, &map, spans,
+					     sizes[i], sizes[i]);
+		gcm_cie_render_tongue (&cs, &map, spans, 0, sizes[i],
+				       cairo_image_surface_get_data (surface),
+				       cairo_image_surface_get_stride (surface));
+		elapsed_raster = g_test_timer_elapsed ();
+		cairo_surface_mark_dirty (surface);
+		cairo_surface_destroy (surface);
+
+		/* mesh, which is a single clipped paint */
+		surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, sizes[i], sizes[i]);
+		g_test_timer_start ();
+		cr = cairo_create (surface);
+		gcm_cie_render_paint_mesh (cr, mesh, &map);
+		cairo_destroy (cr);
+		cairo_surface_flush (surface);
+		elapsed_mesh = g_test_timer_elapsed ();
+		cairo_surface_destroy (surface);
+
+		g_test_minimized_result (elapsed_mesh,
+					 "%ux%u: raster %.1fms, mesh %.1fms",
+					 sizes[i], sizes[i],
+					 elapsed_raster * 1000,
+					 elapsed_mesh * 1000);
+	}
+	cairo_pattern_destroy (mesh);
+}
+
 static void
 gcm_test_trc_widget_func (void)
 {
@@ -163,6 +1131,63 @@ gcm_test_trc_widget_func (void)
 	gtk_widget_destroy (dialog);
 }
 
+static void
+gcm_test_trc_widget_range_func (void)
+{
+	GtkWidget *widget;
+	gboolean found = FALSE;
+	gfloat *samples;
+	gfloat min, max;
+	gfloat min_exact, max_exact;
+	guint end;
+	guint i;
+	guint start;
+	const guint n = 65536;
+	const guint spike = 40000;
+	g_autoptr(GBytes) data = NULL;
+
+	/* a ramp on all three channels, with one bad green sample */
+	samples = g_new (gfloat, n * 3);
+	for (i = 0; i < n; i++) {
+		samples[i] = (gfloat) i / (n - 1);
+		samples[n + i] = (gfloat) i / (n - 1);
+		samples[n * 2 + i] = (gfloat) i / (n - 1);
+	}
+	samples[n + spike] = 1.0f;
+	data = g_bytes_new_take (samples, n * 3 * sizeof (gfloat));
+	widget = gcm_trc_widget_new ();
+	g_object_ref_sink (widget);
+	g_object_set (widget, "data-flat", data, NULL);
+
+	/* the spike is in exactly one of 300 columns */
+	for (i = 0; i < 300; i++) {
+		gcm_trc_widget_get_column_range (GCM_TRC_WIDGET (widget), 1, i, 300, &min, &max);
+		if (max > 0.999f && i < 299) {
+			g_assert (!found);
+			found = TRUE;
+		}
+		gcm_trc_widget_get_column_range (GCM_TRC_WIDGET (widget), 0, i, 300, &min, &max);
+		g_assert_cmpfloat (min, >=, (gfloat) i / 300 - 0.001f);
+		g_assert_cmpfloat (max, <=, (gfloat) (i + 1) / 300 + 0.001f);
+	}
+	g_assert (found);
+
+	/* the pyramid never shows less than the samples do */
+	for (i = 0; i < 1000; i++) {
+		start = g_test_rand_int_range (0, n - 1);
+		end = g_test_rand_int_range (start + 1, n + 1);
+		gcm_trc_widget_get_range (GCM_TRC_WIDGET (widget), 1, start, end,
+					  TRUE, &min_exact, &max_exact);
+		gcm_trc_widget_get_range (GCM_TRC_WIDGET (widget), 1, start, end,
+					  FALSE, &min, &max);
+		g_assert_cmpfloat (min, <=, min_exact);
+		g_assert_cmpfloat (max, >=, max_exact);
+		if (start <= spike && spike < end)
+			g_assert_cmpfloat (max, >=, 1.0f);
+	}
+	g_object_unref (widget);
+}
+
 static void
 gcm_test_utils_func (void)
 {
@@ -173,6 +1198,176 @@ gcm_test_utils_func (void)
 			     "<a href=\"http://www.bbc.co.uk\">http://www.bbc.co.uk</a> really");
 }
 
+static void
+gcm_test_utils_response_func (void)
+{
+	const gfloat *samples;
+	gboolean ret;
+	gdouble expected;
+	gdouble x;
+	gsize size = 0;
+	guint c;
+	guint i;
+	guint n;
+	g_autoptr(CdIcc) icc = cd_icc_new ();
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* sRGB is a matrix/TRC profile, so the tags are used */
+	ret = cd_icc_create_default (icc, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	data = gcm_utils_get_response (icc, 256, &error);
+	g_assert_no_error (error);
+	g_assert (data != NULL);
+	samples = g_bytes_get_data (data, &size);
+	n = size / (3 * sizeof (gfloat));
+	g_assert_cmpint (n, >=, 256);
+
+	/* even the interpolated samples are on the curve */
+	for (c = 0; c < 3; c++) {
+		for (i = 0; i < n; i += 7) {
+			x = (gdouble) i / (n - 1);
+			if (x <= 0.04045)
+				expected = x / 12.92;
+			else
+				expected = pow ((x + 0.055) / 1.055, 2.4);
+			g_assert_cmpfloat (fabs (samples[c * n + i] - expected), <, 0.001);
+		}
+	}
+}
+
+static void
+gcm_test_utils_vcgt_func (void)
+{
+	CdColorRGB *rgb;
+	const gfloat *samples;
+	gboolean ret;
+	gsize size = 0;
+	guint i;
+	const guint n = 65536;
+	g_autoptr(CdIcc) icc = cd_icc_new ();
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) vcgt = g_ptr_array_new_with_free_func ((GDestroyNotify) cd_color_rgb_free);
+
+	/* a linear table with one bad entry */
+	ret = cd_icc_create_default (icc, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (i = 0; i < n; i++) {
+		rgb = cd_color_rgb_new ();
+		cd_color_rgb_set (rgb,
+				  (gdouble) i / (n - 1),
+				  (gdouble) i / (n - 1),
+				  i == 12345 ? 1.0f : (gdouble) i / (n - 1));
+		g_ptr_array_add (vcgt, rgb);
+	}
+	ret = cd_icc_set_vcgt (icc, vcgt, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* every entry, without resampling */
+	data = gcm_utils_get_vcgt (icc, &error);
+	g_assert_no_error (error);
+	g_assert (data != NULL);
+	samples = g_bytes_get_data (data, &size);
+	g_assert_cmpint (size, ==, n * 3 * sizeof (gfloat));
+	g_assert_cmpfloat (fabs (samples[n - 1] - 1.0f), <, 0.0001);
+	g_assert_cmpfloat (fabs (samples[n * 2 + 12344] - 12344.0f / (n - 1)), <, 0.0001);
+	g_assert_cmpfloat (samples[n * 2 + 12345], >, 0.999f);
+}
+
+static CdIcc *
+gcm_test_icc_new_with_description (guint idx)
+{
+	CdIcc *icc;
+	gboolean ret;
+	g_autofree gchar *description = NULL;
+	g_autoptr(CdIcc) tmp = cd_icc_new ();
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* loaded from data, so it has a checksum that differs for each */
+	ret = cd_icc_create_default (tmp, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	description = g_strdup_printf ("Test %u", idx);
+	cd_icc_set_description (tmp, NULL, description);
+	data = cd_icc_save_data (tmp, CD_ICC_SAVE_FLAGS_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (data != NULL);
+	icc = cd_icc_new ();
+	ret = cd_icc_load_data (icc,
+				g_bytes_get_data (data, NULL),
+				g_bytes_get_size (data),
+				CD_ICC_LOAD_FLAGS_NONE,
+				&error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (cd_icc_get_checksum (icc) != NULL);
+	return icc;
+}
+
+static void
+gcm_test_utils_image_convert_func (void)
+{
+	CdIcc *iccs[9];
+	GdkPixbuf *pixbuf;
+	GtkWidget *image;
+	gboolean ret;
+	guchar *pixels;
+	guint hits;
+	guint i;
+	g_autoptr(GError) error = NULL;
+
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 4, 4);
+	gdk_pixbuf_fill (pixbuf, 0x804020ff);
+	image = gtk_image_new_from_pixbuf (pixbuf);
+	g_object_ref_sink (image);
+	g_object_unref (pixbuf);
+
+	/* sRGB to sRGB, the second time from the transform cache */
+	hits = gcm_utils_get_transform_cache_hits ();
+	for (i = 0; i < 2; i++) {
+		ret = gcm_utils_image_convert (GTK_IMAGE (image), NULL, NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+	}
+	g_assert_cmpint (gcm_utils_get_transform_cache_hits (), ==, hits + 1);
+	pixels = gdk_pixbuf_get_pixels (gtk_image_get_pixbuf (GTK_IMAGE (image)));
+	g_assert_cmpint (ABS (pixels[0] - 0x80), <=, 2);
+	g_assert_cmpint (ABS (pixels[1] - 0x40), <=, 2);
+	g_assert_cmpint (ABS (pixels[2] - 0x20), <=, 2);
+
+	/* one more profile than fits, so the first is pushed out */
+	for (i = 0; i < G_N_ELEMENTS (iccs); i++)
+		iccs[i] = gcm_test_icc_new_with_description (i);
+	hits = gcm_utils_get_transform_cache_hits ();
+	for (i = 0; i < G_N_ELEMENTS (iccs); i++) {
+		ret = gcm_utils_image_convert (GTK_IMAGE (image), iccs[i], NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+	}
+	g_assert_cmpint (gcm_utils_get_transform_cache_hits (), ==, hits);
+
+	/* the newest is still there */
+	ret = gcm_utils_image_convert (GTK_IMAGE (image), iccs[8], NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gcm_utils_get_transform_cache_hits (), ==, hits + 1);
+
+	/* but the oldest was evicted */
+	ret = gcm_utils_image_convert (GTK_IMAGE (image), iccs[0], NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (gcm_utils_get_transform_cache_hits (), ==, hits + 1);
+
+	for (i = 0; i < G_N_ELEMENTS (iccs); i++)
+		g_object_unref (iccs[i]);
+	g_object_unref (image);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -183,10 +1378,38 @@ main (int argc, char **argv)
 	gcm_debug_setup (g_getenv ("VERBOSE") != NULL);
 
 	g_test_add_func ("/color/utils", gcm_test_utils_func);
+	g_test_add_func ("/color/utils-response", gcm_test_utils_response_func);
+	g_test_add_func ("/color/utils-vcgt", gcm_test_utils_vcgt_func);
+	g_test_add_func ("/color/utils-image-convert", gcm_test_utils_image_convert_func);
+	g_test_add_func ("/color/cie-overlay", gcm_test_cie_widget_overlay_func);
+	g_test_add_func ("/color/cie-render", gcm_test_cie_render_func);
+	g_test_add_func ("/color/cie-render-transfer", gcm_test_cie_render_transfer_func);
+	g_test_add_func ("/color/cie-render-kernels", gcm_test_cie_render_kernels_func);
+	g_test_add_func ("/color/cie-render-tongue", gcm_test_cie_render_tongue_func);
+	g_test_add_func ("/color/cie-render-scan", gcm_test_cie_render_scan_func);
+	g_test_add_func ("/color/cie-render-mesh", gcm_test_cie_render_mesh_func);
+	g_test_add_func ("/color/cie-render-hue", gcm_test_cie_render_hue_func);
+	g_test_add_func ("/color/cie-render-profile", gcm_test_cie_render_profile_func);
+	g_test_add_func ("/color/cie-render-export", gcm_test_cie_render_export_func);
+	g_test_add_func ("/color/cie-histogram", gcm_test_cie_histogram_func);
+	g_test_add_func ("/color/cie-histogram-pixbuf", gcm_test_cie_histogram_pixbuf_func);
+	g_test_add_func ("/color/cie-histogram-named", gcm_test_cie_histogram_named_func);
+	g_test_add_func ("/color/label-cache", gcm_test_label_cache_func);
+	g_test_add_func ("/color/cct", gcm_test_cct_func);
+	g_test_add_func ("/color/trc-range", gcm_test_trc_widget_range_func);
+	if (g_test_perf ()) {
+		g_test_add_func ("/color/cie-render-perf", gcm_test_cie_render_perf_func);
+		g_test_add_func ("/color/cie-render-parallel-perf", gcm_test_cie_render_parallel_perf_func);
+		g_test_add_func ("/color/cie-render-engine-perf", gcm_test_cie_render_engine_perf_func);
+		g_test_add_func ("/color/cie-histogram-perf", gcm_test_cie_histogram_perf_func);
+		g_test_add_func ("/color/cct-perf", gcm_test_cct_perf_func);
+		g_test_add_func ("/color/gamma-widget-live-perf", gcm_test_gamma_widget_live_perf_func);
+	}
 	if (g_test_thorough ()) {
 		g_test_add_func ("/color/trc", gcm_test_trc_widget_func);
 		g_test_add_func ("/color/cie", gcm_test_cie_widget_func);
 		g_test_add_func ("/color/gamma_widget", gcm_test_gamma_widget_func);
+		g_test_add_func ("/color/gamma-widget-live", gcm_test_gamma_widget_live_func);
 	}
 
 	return g_test_run ();
@@ -9,37 +9,193 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <colord.h>
 
 #include "gcm-trc-widget.h"
+#include "gcm-label-cache.h"
+#include "gcm-utils.h"
 
 G_DEFINE_TYPE (GcmTrcWidget, gcm_trc_widget, GTK_TYPE_DRAWING_AREA);
 #define GCM_TRC_WIDGET_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), GCM_TYPE_TRC_WIDGET, GcmTrcWidgetPrivate))
 #define GCM_TRC_WIDGET_FONT "Sans 8"
+#define GCM_TRC_WIDGET_LEVELS		32	/* enough for any guint */
+#define GCM_TRC_WIDGET_SETTLE_TIMEOUT	150	/* ms after the last zoom or pan */
+#define GCM_TRC_WIDGET_ZOOM_STEP	1.25f	/* for each scroll click */
+#define GCM_TRC_WIDGET_ZOOM_MIN		0.001f	/* of the full range */
+
+typedef struct {
+	gfloat			*min;			/* of each block, all red, then green, then blue */
+	gfloat			*max;
+	guint			 len;			/* blocks in each channel */
+} GcmTrcWidgetLevel;
 
 struct GcmTrcWidgetPrivate
 {
 	gboolean		 use_grid;
-	GPtrArray		*data;
+	GBytes			*data;			/* all red, then green, then blue */
+	const gfloat		*samples;		/* of the above */
+	guint			 n_samples;		/* for each channel */
+	GcmTrcWidgetLevel	 levels[GCM_TRC_WIDGET_LEVELS];	/* blocks of 1 << index samples */
+	guint			 n_levels;		/* including the samples themselves */
+	gdouble			 view_x;		/* input at the left edge */
+	gdouble			 view_y;		/* output at the bottom edge */
+	gdouble			 view_size;		/* of both axes, 1.0 for everything */
+	gboolean		 dragging;
+	gdouble			 drag_x;		/* pointer at the button press */
+	gdouble			 drag_y;
+	gdouble			 drag_view_x;		/* view at the button press */
+	gdouble			 drag_view_y;
+	guint			 settle_id;		/* drawing from the levels until this fires */
 	guint			 chart_width;
 	guint			 chart_height;
 	PangoLayout		*layout;
+	GcmLabelCache		*labels;		/* axis text */
 	guint			 x_offset;
 	guint			 y_offset;
+	CdIcc			*display_profile;	/* or NULL for none */
+	cmsHTRANSFORM		 display_transform;	/* from sRGB */
+	cairo_surface_t		*surface;		/* grid, labels and curves */
+	guint			 surface_width;
+	guint			 surface_height;
+	gint			 surface_scale;
 };
 
 static gboolean gcm_trc_widget_draw (GtkWidget *trc, cairo_t *cr);
+static void	gcm_trc_widget_style_updated (GtkWidget *widget);
 static void	gcm_trc_widget_finalize (GObject *object);
+static gboolean gcm_trc_widget_scroll_event (GtkWidget *widget, GdkEventScroll *event);
+static gboolean gcm_trc_widget_button_press_event (GtkWidget *widget, GdkEventButton *event);
+static gboolean gcm_trc_widget_button_release_event (GtkWidget *widget, GdkEventButton *event);
+static gboolean gcm_trc_widget_motion_notify_event (GtkWidget *widget, GdkEventMotion *event);
 
 enum
 {
 	PROP_0,
 	PROP_USE_GRID,
 	PROP_DATA,
+	PROP_DATA_FLAT,
+	PROP_DISPLAY_PROFILE,
 	PROP_LAST
 };
 
+static void
+gcm_trc_widget_invalidate (GcmTrcWidget *trc)
+{
+	/* everything is drawn again on the next draw */
+	if (trc->priv->surface != NULL) {
+		cairo_surface_destroy (trc->priv->surface);
+		trc->priv->surface = NULL;
+	}
+}
+
+static void
+gcm_trc_widget_free_levels (GcmTrcWidget *trc)
+{
+	GcmTrcWidgetPrivate *priv = trc->priv;
+	guint i;
+
+	/* the first level is the samples themselves */
+	for (i = 1; i < priv->n_levels; i++) {
+		g_free (priv->levels[i].min);
+		g_free (priv->levels[i].max);
+	}
+	memset (priv->levels, 0, sizeof (priv->levels));
+	priv->n_levels = 0;
+}
+
+static void
+gcm_trc_widget_build_levels (GcmTrcWidget *trc)
+{
+	GcmTrcWidgetLevel *level;
+	const GcmTrcWidgetLevel *prev;
+	guint a, b;
+	guint c;
+	guint i;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	if (priv->n_samples == 0)
+		return;
+
+	/* each level is the range of pairs of blocks in the one below */
+	priv->levels[0].min = (gfloat *) priv->samples;
+	priv->levels[0].max = (gfloat *) priv->samples;
+	priv->levels[0].len = priv->n_samples;
+	for (priv->n_levels = 1; priv->n_levels < GCM_TRC_WIDGET_LEVELS; priv->n_levels++) {
+		prev = &priv->levels[priv->n_levels - 1];
+		if (prev->len <= 1)
+			break;
+		level = &priv->levels[priv->n_levels];
+		level->len = (prev->len + 1) / 2;
+		level->min = g_new (gfloat, level->len * 3);
+		level->max = g_new (gfloat, level->len * 3);
+		for (c = 0; c < 3; c++) {
+			for (i = 0; i < level->len; i++) {
+				a = c * prev->len + i * 2;
+				b = c * prev->len + MIN (i * 2 + 1, prev->len - 1);
+				level->min[c * level->len + i] = MIN (prev->min[a], prev->min[b]);
+				level->max[c * level->len + i] = MAX (prev->max[a], prev->max[b]);
+			}
+		}
+	}
+}
+
+static void
+gcm_trc_widget_set_data_flat (GcmTrcWidget *trc, GBytes *data)
+{
+	GcmTrcWidgetPrivate *priv = trc->priv;
+	gsize size = 0;
+
+	gcm_trc_widget_free_levels (trc);
+	if (priv->data != NULL)
+		g_bytes_unref (priv->data);
+	priv->data = NULL;
+	priv->samples = NULL;
+	priv->n_samples = 0;
+
+	/* nothing to show */
+	if (data == NULL)
+		return;
+	if (g_bytes_get_size (data) % (3 * sizeof (gfloat)) != 0) {
+		g_warning ("curve data is not three channels of floats");
+		return;
+	}
+	priv->data = g_bytes_ref (data);
+	priv->samples = g_bytes_get_data (data, &size);
+	priv->n_samples = size / (3 * sizeof (gfloat));
+
+	/* so zooming and panning never has to look at every sample */
+	gcm_trc_widget_build_levels (trc);
+}
+
+static void
+gcm_trc_widget_set_data (GcmTrcWidget *trc, GPtrArray *array)
+{
+	CdColorRGB *rgb;
+	gfloat *samples;
+	guint i;
+	guint n;
+	g_autoptr(GBytes) data = NULL;
+
+	if (array == NULL) {
+		gcm_trc_widget_set_data_flat (trc, NULL);
+		return;
+	}
+
+	/* the same layout as data-flat, so there is only one draw path */
+	n = array->len;
+	samples = g_new (gfloat, n * 3);
+	for (i = 0; i < n; i++) {
+		rgb = g_ptr_array_index (array, i);
+		samples[i] = rgb->R;
+		samples[n + i] = rgb->G;
+		samples[n * 2 + i] = rgb->B;
+	}
+	data = g_bytes_new_take (samples, n * 3 * sizeof (gfloat));
+	gcm_trc_widget_set_data_flat (trc, data);
+}
+
 static void
 gcm_trc_widget_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
@@ -48,6 +204,9 @@ gcm_trc_widget_get_property (GObject *object, guint prop_id, GValue *value, GPar
 	case PROP_USE_GRID:
 		g_value_set_boolean (value, trc->priv->use_grid);
 		break;
+	case PROP_DISPLAY_PROFILE:
+		g_value_set_object (value, trc->priv->display_profile);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -64,18 +223,27 @@ gcm_trc_widget_set_property (GObject *object, guint prop_id, const GValue *value
 		trc->priv->use_grid = g_value_get_boolean (value);
 		break;
 	case PROP_DATA:
-		if (trc->priv->data != NULL)
-			g_ptr_array_unref (trc->priv->data);
-		trc->priv->data = g_ptr_array_ref (g_value_get_boxed (value));
+		gcm_trc_widget_set_data (trc, g_value_get_boxed (value));
+		break;
+	case PROP_DATA_FLAT:
+		gcm_trc_widget_set_data_flat (trc, g_value_get_boxed (value));
+		break;
+	case PROP_DISPLAY_PROFILE:
+		if (!g_set_object (&trc->priv->display_profile, g_value_get_object (value)))
+			return;
+		if (trc->priv->display_transform != NULL) {
+			cmsDeleteTransform (trc->priv->display_transform);
+			trc->priv->display_transform = NULL;
+		}
 		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
-		break;
+		return;
 	}
 
-	/* refresh widget */
-	gtk_widget_hide (GTK_WIDGET (trc));
-	gtk_widget_show (GTK_WIDGET (trc));
+	/* coalesced with any other changes until the next frame */
+	gcm_trc_widget_invalidate (trc);
+	gtk_widget_queue_draw (GTK_WIDGET (trc));
 }
 
 static void
@@ -85,6 +253,11 @@ gcm_trc_widget_class_init (GcmTrcWidgetClass *class)
 	GObjectClass *object_class = G_OBJECT_CLASS (class);
 
 	widget_class->draw = gcm_trc_widget_draw;
+	widget_class->style_updated = gcm_trc_widget_style_updated;
+	widget_class->scroll_event = gcm_trc_widget_scroll_event;
+	widget_class->button_press_event = gcm_trc_widget_button_press_event;
+	widget_class->button_release_event = gcm_trc_widget_button_release_event;
+	widget_class->motion_notify_event = gcm_trc_widget_motion_notify_event;
 	object_class->get_property = gcm_trc_widget_get_property;
 	object_class->set_property = gcm_trc_widget_set_property;
 	object_class->finalize = gcm_trc_widget_finalize;
@@ -102,6 +275,18 @@ gcm_trc_widget_class_init (GcmTrcWidgetClass *class)
 					 g_param_spec_boxed ("data", NULL, NULL,
 							     G_TYPE_PTR_ARRAY,
 							     G_PARAM_WRITABLE));
+
+	/* all the red floats, then the green, then the blue */
+	g_object_class_install_property (object_class,
+					 PROP_DATA_FLAT,
+					 g_param_spec_boxed ("data-flat", NULL, NULL,
+							     G_TYPE_BYTES,
+							     G_PARAM_WRITABLE));
+	g_object_class_install_property (object_class,
+					 PROP_DISPLAY_PROFILE,
+					 g_param_spec_object ("display-profile", NULL, NULL,
+							      CD_TYPE_ICC,
+							      G_PARAM_READWRITE));
 }
 
 static void
@@ -112,7 +297,13 @@ gcm_trc_widget_init (GcmTrcWidget *trc)
 
 	trc->priv = GCM_TRC_WIDGET_GET_PRIVATE (trc);
 	trc->priv->use_grid = TRUE;
-	trc->priv->data = NULL;
+	trc->priv->view_size = 1.0f;
+
+	/* for zooming and panning */
+	gtk_widget_add_events (GTK_WIDGET (trc),
+			       GDK_SCROLL_MASK | GDK_SMOOTH_SCROLL_MASK |
+			       GDK_BUTTON_PRESS_MASK | GDK_BUTTON_RELEASE_MASK |
+			       GDK_BUTTON1_MOTION_MASK);
 
 	/* do pango stuff */
 	context = gtk_widget_get_pango_context (GTK_WIDGET (trc));
@@ -122,6 +313,7 @@ gcm_trc_widget_init (GcmTrcWidget *trc)
 	desc = pango_font_description_from_string (GCM_TRC_WIDGET_FONT);
 	pango_layout_set_font_description (trc->priv->layout, desc);
 	pango_font_description_free (desc);
+	trc->priv->labels = gcm_label_cache_new (trc->priv->layout);
 }
 
 static void
@@ -129,9 +321,18 @@ gcm_trc_widget_finalize (GObject *object)
 {
 	GcmTrcWidget *trc = (GcmTrcWidget*) object;
 
+	if (trc->priv->settle_id != 0)
+		g_source_remove (trc->priv->settle_id);
+	gcm_trc_widget_free_levels (trc);
+	gcm_label_cache_free (trc->priv->labels);
 	g_object_unref (trc->priv->layout);
 	if (trc->priv->data != NULL)
-		g_ptr_array_unref (trc->priv->data);
+		g_bytes_unref (trc->priv->data);
+	if (trc->priv->display_transform != NULL)
+		cmsDeleteTransform (trc->priv->display_transform);
+	if (trc->priv->display_profile != NULL)
+		g_object_unref (trc->priv->display_profile);
+	gcm_trc_widget_invalidate (trc);
 	G_OBJECT_CLASS (gcm_trc_widget_parent_class)->finalize (object);
 }
 
@@ -173,82 +374,373 @@ gcm_trc_widget_map_to_display (GcmTrcWidget *trc, gdouble x, gdouble y, gdouble
 {
 	GcmTrcWidgetPrivate *priv = trc->priv;
 
+	/* relative to the zoomed view */
+	x = (x - priv->view_x) / priv->view_size;
+	y = (y - priv->view_y) / priv->view_size;
 	*x_retval = (x * (priv->chart_width - 1)) + priv->x_offset;
 	*y_retval = ((priv->chart_height - 1) - y * (priv->chart_height - 1)) - priv->y_offset;
 }
 
 static void
-gcm_trc_widget_draw_line (GcmTrcWidget *trc, cairo_t *cr)
+gcm_trc_widget_map_from_display (GcmTrcWidget *trc, gdouble x, gdouble y, gdouble *x_retval, gdouble *y_retval)
 {
-	gdouble wx, wy;
 	GcmTrcWidgetPrivate *priv = trc->priv;
-	CdColorRGB *tmp;
-	gfloat i;
-	gfloat value;
-	gfloat size;
-	gfloat linewidth;
 
-	/* nothing set yet */
-	if (priv->data == NULL)
+	x = (x - priv->x_offset) / (priv->chart_width - 1);
+	y = ((priv->chart_height - 1) - priv->y_offset - y) / (priv->chart_height - 1);
+	*x_retval = priv->view_x + x * priv->view_size;
+	*y_retval = priv->view_y + y * priv->view_size;
+}
+
+static gboolean
+gcm_trc_widget_settle_cb (gpointer user_data)
+{
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (user_data);
+
+	/* the view has stopped moving, so do the exact render */
+	trc->priv->settle_id = 0;
+	gcm_trc_widget_invalidate (trc);
+	gtk_widget_queue_draw (GTK_WIDGET (trc));
+	return G_SOURCE_REMOVE;
+}
+
+static void
+gcm_trc_widget_set_view (GcmTrcWidget *trc, gdouble x, gdouble y, gdouble size)
+{
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	/* never outside the curve */
+	size = CLAMP (size, GCM_TRC_WIDGET_ZOOM_MIN, 1.0f);
+	x = CLAMP (x, 0.0f, 1.0f - size);
+	y = CLAMP (y, 0.0f, 1.0f - size);
+
+	/* already at the edge, or fully zoomed out */
+	if (x == priv->view_x && y == priv->view_y && size == priv->view_size)
 		return;
+	priv->view_x = x;
+	priv->view_y = y;
+	priv->view_size = size;
+
+	/* draw from the levels until the view is stable */
+	if (priv->settle_id != 0)
+		g_source_remove (priv->settle_id);
+	priv->settle_id = g_timeout_add (GCM_TRC_WIDGET_SETTLE_TIMEOUT,
+					 gcm_trc_widget_settle_cb, trc);
+	gcm_trc_widget_invalidate (trc);
+	gtk_widget_queue_draw (GTK_WIDGET (trc));
+}
 
-	/* set according to widget width */
-	linewidth = priv->chart_width / 250.0f;
-	size = priv->data->len;
+static gboolean
+gcm_trc_widget_scroll_event (GtkWidget *widget, GdkEventScroll *event)
+{
+	gdouble factor;
+	gdouble size;
+	gdouble x, y;
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (widget);
+	GcmTrcWidgetPrivate *priv = trc->priv;
 
-	cairo_save (cr);
+	if (priv->chart_width <= 1 || priv->chart_height <= 1)
+		return FALSE;
+	switch (event->direction) {
+	case GDK_SCROLL_UP:
+		factor = 1.0f / GCM_TRC_WIDGET_ZOOM_STEP;
+		break;
+	case GDK_SCROLL_DOWN:
+		factor = GCM_TRC_WIDGET_ZOOM_STEP;
+		break;
+	case GDK_SCROLL_SMOOTH:
+		factor = pow (GCM_TRC_WIDGET_ZOOM_STEP, event->delta_y);
+		break;
+	default:
+		return FALSE;
+	}
 
-	/* do red */
-	cairo_set_line_width (cr, linewidth + 1.0f);
-	cairo_set_source_rgb (cr, 0.5f, 0.0f, 0.0f);
-	for (i = 0; i < size; i++) {
-		tmp = g_ptr_array_index (priv->data, (guint) i);
-		value = tmp->R;
-		gcm_trc_widget_map_to_display (trc, i/(size-1), value, &wx, &wy);
-		if (i == 0)
-			cairo_move_to (cr, wx, wy+1);
-		else
-			cairo_line_to (cr, wx, wy+1);
+	/* keep the point under the pointer where it is */
+	gcm_trc_widget_map_from_display (trc, event->x, event->y, &x, &y);
+	size = CLAMP (priv->view_size * factor, GCM_TRC_WIDGET_ZOOM_MIN, 1.0f);
+	gcm_trc_widget_set_view (trc,
+				 x - (x - priv->view_x) * size / priv->view_size,
+				 y - (y - priv->view_y) * size / priv->view_size,
+				 size);
+	return TRUE;
+}
+
+static gboolean
+gcm_trc_widget_button_press_event (GtkWidget *widget, GdkEventButton *event)
+{
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (widget);
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	if (event->button != 1)
+		return FALSE;
+
+	/* back to the whole curve */
+	if (event->type == GDK_2BUTTON_PRESS) {
+		priv->dragging = FALSE;
+		gcm_trc_widget_set_view (trc, 0.0f, 0.0f, 1.0f);
+		return TRUE;
 	}
-	cairo_stroke_preserve (cr);
-	cairo_set_line_width (cr, linewidth);
-	cairo_set_source_rgb (cr, 1.0f, 0.0f, 0.0f);
-	cairo_stroke (cr);
+	priv->dragging = TRUE;
+	priv->drag_x = event->x;
+	priv->drag_y = event->y;
+	priv->drag_view_x = priv->view_x;
+	priv->drag_view_y = priv->view_y;
+	return TRUE;
+}
 
-	/* do green */
-	cairo_set_line_width (cr, linewidth + 1.0f);
-	cairo_set_source_rgb (cr, 0.0f, 0.5f, 0.0f);
-	for (i = 0; i < size; i++) {
-		tmp = g_ptr_array_index (priv->data, (guint) i);
-		value = tmp->G;
-		gcm_trc_widget_map_to_display (trc, i/(size-1), value, &wx, &wy);
-		if (i == 0)
-			cairo_move_to (cr, wx, wy-1);
-		else
-			cairo_line_to (cr, wx, wy-1);
+static gboolean
+gcm_trc_widget_button_release_event (GtkWidget *widget, GdkEventButton *event)
+{
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (widget);
+	if (event->button != 1)
+		return FALSE;
+	trc->priv->dragging = FALSE;
+	return TRUE;
+}
+
+static gboolean
+gcm_trc_widget_motion_notify_event (GtkWidget *widget, GdkEventMotion *event)
+{
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (widget);
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	if (!priv->dragging || priv->chart_width <= 1 || priv->chart_height <= 1)
+		return FALSE;
+
+	/* the curve follows the pointer */
+	gcm_trc_widget_set_view (trc,
+				 priv->drag_view_x - (event->x - priv->drag_x) *
+				 priv->view_size / (priv->chart_width - 1),
+				 priv->drag_view_y + (event->y - priv->drag_y) *
+				 priv->view_size / (priv->chart_height - 1),
+				 priv->view_size);
+	return TRUE;
+}
+
+static void
+gcm_trc_widget_style_updated (GtkWidget *widget)
+{
+	GcmTrcWidget *trc = GCM_TRC_WIDGET (widget);
+
+	/* the font may have changed */
+	GTK_WIDGET_CLASS (gcm_trc_widget_parent_class)->style_updated (widget);
+	if (trc->priv->labels != NULL)
+		gcm_label_cache_invalidate (trc->priv->labels);
+	gcm_trc_widget_invalidate (trc);
+}
+
+static void
+gcm_trc_widget_draw_labels (GcmTrcWidget *trc, cairo_t *cr)
+{
+	gchar text[16];
+	gdouble wx, wy;
+	gdouble ox, oy;
+	gdouble x, y;
+	gint digits;
+	guint i;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	/* enough digits to tell the grid lines apart when zoomed */
+	digits = CLAMP ((gint) ceil (-log10 (priv->view_size / 10.0f) - 0.001f), 1, 6);
+
+	/* inside the bottom and left edges, next to every other grid line */
+	gcm_trc_widget_map_to_display (trc, priv->view_x, priv->view_y, &ox, &oy);
+	for (i = 2; i < 10; i += 2) {
+		x = priv->view_x + priv->view_size * i / 10.0f;
+		y = priv->view_y + priv->view_size * i / 10.0f;
+		gcm_trc_widget_map_to_display (trc, x, y, &wx, &wy);
+		g_snprintf (text, sizeof (text), "%.*f", digits, x);
+		gcm_label_cache_paint (priv->labels, cr, text, wx + 2, oy - 2, 0.0f, 1.0f);
+		g_snprintf (text, sizeof (text), "%.*f", digits, y);
+		gcm_label_cache_paint (priv->labels, cr, text, ox + 2, wy - 1, 0.0f, 1.0f);
 	}
-	cairo_stroke_preserve (cr);
-	cairo_set_line_width (cr, linewidth);
-	cairo_set_source_rgb (cr, 0.0f, 1.0f, 0.0f);
-	cairo_stroke (cr);
+}
+
+/**
+ * gcm_trc_widget_get_range:
+ * @trc: a #GcmTrcWidget
+ * @channel: 0 for red, 1 for green and 2 for blue
+ * @start: the first sample
+ * @end: the sample after the last, greater than @start
+ * @exact: %FALSE to use the level of detail pyramid
+ * @min: the returned smallest value
+ * @max: the returned biggest value
+ *
+ * Gets the range of the curve over some samples. When not @exact only a
+ * few blocks of the pyramid are read, and the range may be slightly
+ * bigger than the real one, but never smaller.
+ **/
+void
+gcm_trc_widget_get_range (GcmTrcWidget *trc, guint channel,
+			  guint start, guint end, gboolean exact,
+			  gfloat *min, gfloat *max)
+{
+	const GcmTrcWidgetLevel *level;
+	guint first, last;
+	guint i;
+	guint l = 0;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	g_return_if_fail (channel < 3);
+	g_return_if_fail (start < end && end <= priv->n_samples);
+
+	/* the coarsest level with blocks no bigger than the range, so only
+	 * a few blocks are needed whatever the zoom */
+	if (!exact) {
+		while (l + 1 < priv->n_levels && (2u << l) <= end - start)
+			l++;
+	}
+	level = &priv->levels[l];
+	first = start >> l;
+	last = (end - 1) >> l;
+	*min = level->min[channel * level->len + first];
+	*max = level->max[channel * level->len + first];
+	for (i = first + 1; i <= last; i++) {
+		if (level->min[channel * level->len + i] < *min)
+			*min = level->min[channel * level->len + i];
+		if (level->max[channel * level->len + i] > *max)
+			*max = level->max[channel * level->len + i];
+	}
+}
+
+static void
+gcm_trc_widget_get_column_samples (GcmTrcWidget *trc, guint column, guint columns,
+				   guint *start, guint *end)
+{
+	gdouble first, visible;
+	guint n = trc->priv->n_samples;
+
+	/* the samples in the view under this column */
+	first = trc->priv->view_x * (n - 1);
+	visible = trc->priv->view_size * (n - 1);
+	*start = first + (visible + 1) * column / columns;
+	*end = first + (visible + 1) * (column + 1) / columns;
+	*start = MIN (*start, n - 1);
+	*end = CLAMP (*end, *start + 1, n);
+}
+
+/**
+ * gcm_trc_widget_get_column_range:
+ * @trc: a #GcmTrcWidget
+ * @channel: 0 for red, 1 for green and 2 for blue
+ * @column: the pixel column
+ * @columns: the number of pixel columns
+ * @min: the returned smallest value
+ * @max: the returned biggest value
+ *
+ * Gets the range of the curve that is drawn in one pixel column of the
+ * current view, so that no spike between the columns is lost.
+ **/
+void
+gcm_trc_widget_get_column_range (GcmTrcWidget *trc, guint channel,
+				 guint column, guint columns,
+				 gfloat *min, gfloat *max)
+{
+	guint start, end;
+
+	g_return_if_fail (trc->priv->n_samples > 0);
+	g_return_if_fail (column < columns);
+
+	gcm_trc_widget_get_column_samples (trc, column, columns, &start, &end);
+	gcm_trc_widget_get_range (trc, channel, start, end,
+				  trc->priv->settle_id == 0, min, max);
+}
+
+static void
+gcm_trc_widget_draw_channel (GcmTrcWidget *trc, cairo_t *cr,
+			     guint channel, gdouble offset,
+			     const GdkRGBA *dark, const GdkRGBA *light)
+{
+	const gfloat *samples;
+	gboolean exact;
+	gdouble first, visible;
+	gdouble last = 0.0f;
+	gdouble linewidth;
+	gdouble wx, wy;
+	gfloat min, max;
+	guint columns;
+	guint end;
+	guint i;
+	guint n;
+	guint start;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	/* set according to widget width */
+	linewidth = priv->chart_width / 250.0f;
+	n = priv->n_samples;
+	samples = priv->samples + channel * n;
+	columns = MAX (priv->chart_width * priv->surface_scale, 1);
+
+	/* only the samples in the view */
+	first = priv->view_x * (n - 1);
+	visible = priv->view_size * (n - 1);
+	exact = priv->settle_id == 0;
 
-	/* do blue */
 	cairo_set_line_width (cr, linewidth + 1.0f);
-	cairo_set_source_rgb (cr, 0.0f, 0.0f, 0.5f);
-	for (i = 0; i < size; i++) {
-		tmp = g_ptr_array_index (priv->data, (guint) i);
-		value = tmp->B;
-		gcm_trc_widget_map_to_display (trc, i/(size-1), value, &wx, &wy);
-		if (i == 0)
-			cairo_move_to (cr, wx, wy);
-		else
-			cairo_line_to (cr, wx, wy);
+	gdk_cairo_set_source_rgba (cr, dark);
+	if (visible <= columns * 2) {
+		/* few enough to draw every sample, and one either side */
+		start = floor (first);
+		end = MIN ((guint) ceil (first + visible) + 1, n);
+		for (i = start; i < end; i++) {
+			gcm_trc_widget_map_to_display (trc, (gdouble) i / (n - 1),
+						       samples[i], &wx, &wy);
+			if (i == start)
+				cairo_move_to (cr, wx, wy + offset);
+			else
+				cairo_line_to (cr, wx, wy + offset);
+		}
+	} else {
+		/* the range of each pixel column, so spikes are not lost */
+		for (i = 0; i < columns; i++) {
+			gcm_trc_widget_get_column_samples (trc, i, columns, &start, &end);
+			gcm_trc_widget_get_range (trc, channel, start, end, exact, &min, &max);
+
+			/* join on to whichever end is nearest the last column */
+			if (i > 0 && fabs (last - max) < fabs (last - min)) {
+				gdouble tmp = min;
+				min = max;
+				max = tmp;
+			}
+			gcm_trc_widget_map_to_display (trc, (start + end - 1) / 2.0 / (n - 1),
+						       min, &wx, &wy);
+			if (i == 0)
+				cairo_move_to (cr, wx, wy + offset);
+			else
+				cairo_line_to (cr, wx, wy + offset);
+			if (max != min) {
+				gcm_trc_widget_map_to_display (trc, (start + end - 1) / 2.0 / (n - 1),
+							       max, &wx, &wy);
+				cairo_line_to (cr, wx, wy + offset);
+			}
+			last = max;
+		}
 	}
 	cairo_stroke_preserve (cr);
 	cairo_set_line_width (cr, linewidth);
-	cairo_set_source_rgb (cr, 0.0f, 0.0f, 1.0f);
+	gdk_cairo_set_source_rgba (cr, light);
 	cairo_stroke (cr);
+}
+
+static void
+gcm_trc_widget_draw_line (GcmTrcWidget *trc, cairo_t *cr)
+{
+	const GdkRGBA red_dark = { 0.5f, 0.0f, 0.0f, 1.0f };
+	const GdkRGBA red_light = { 1.0f, 0.0f, 0.0f, 1.0f };
+	const GdkRGBA green_dark = { 0.0f, 0.5f, 0.0f, 1.0f };
+	const GdkRGBA green_light = { 0.0f, 1.0f, 0.0f, 1.0f };
+	const GdkRGBA blue_dark = { 0.0f, 0.0f, 0.5f, 1.0f };
+	const GdkRGBA blue_light = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+	/* nothing set yet */
+	if (trc->priv->n_samples < 2)
+		return;
 
+	/* offset slightly so that identical curves are all visible */
+	cairo_save (cr);
+	gcm_trc_widget_draw_channel (trc, cr, 0, 1.0f, &red_dark, &red_light);
+	gcm_trc_widget_draw_channel (trc, cr, 1, -1.0f, &green_dark, &green_light);
+	gcm_trc_widget_draw_channel (trc, cr, 2, 0.0f, &blue_dark, &blue_light);
 	cairo_restore (cr);
 }
 
@@ -267,6 +759,69 @@ gcm_trc_widget_draw_bounding_box (cairo_t *cr, gint x, gint y, gint width, gint
 	cairo_stroke (cr);
 }
 
+static void
+gcm_trc_widget_draw_layers (GcmTrcWidget *trc, cairo_t *cr)
+{
+	/* trc background */
+	gcm_trc_widget_draw_bounding_box (cr, 0, 0, trc->priv->chart_width, trc->priv->chart_height);
+	if (trc->priv->use_grid)
+		gcm_trc_widget_draw_grid (trc, cr);
+	gcm_trc_widget_draw_labels (trc, cr);
+
+	gcm_trc_widget_draw_line (trc, cr);
+}
+
+static cmsHTRANSFORM
+gcm_trc_widget_get_display_transform (GcmTrcWidget *trc)
+{
+	cmsHPROFILE profile;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	/* the curves are drawn in sRGB */
+	if (priv->display_profile == NULL)
+		return NULL;
+	if (priv->display_transform == NULL) {
+		profile = cmsCreate_sRGBProfile ();
+		priv->display_transform = gcm_utils_create_display_transform (profile,
+									      priv->display_profile);
+		cmsCloseProfile (profile);
+	}
+	return priv->display_transform;
+}
+
+static void
+gcm_trc_widget_ensure_surface (GcmTrcWidget *trc, gint scale)
+{
+	cairo_t *cr;
+	cmsHTRANSFORM transform;
+	GcmTrcWidgetPrivate *priv = trc->priv;
+
+	/* still valid for this data, size and scale */
+	if (priv->surface != NULL &&
+	    priv->surface_width == priv->chart_width &&
+	    priv->surface_height == priv->chart_height &&
+	    priv->surface_scale == scale)
+		return;
+
+	gcm_trc_widget_invalidate (trc);
+	priv->surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+						    priv->chart_width * scale,
+						    priv->chart_height * scale);
+	cairo_surface_set_device_scale (priv->surface, scale, scale);
+	priv->surface_width = priv->chart_width;
+	priv->surface_height = priv->chart_height;
+	priv->surface_scale = scale;
+
+	cr = cairo_create (priv->surface);
+	gcm_trc_widget_draw_layers (trc, cr);
+	cairo_destroy (cr);
+
+	/* converted once, not on every draw */
+	transform = gcm_trc_widget_get_display_transform (trc);
+	if (transform != NULL)
+		gcm_utils_transform_surface (transform, priv->surface);
+}
+
 static void
 gcm_trc_widget_draw_trc (GtkWidget *trc_widget, cairo_t *cr)
 {
@@ -285,13 +840,14 @@ gcm_trc_widget_draw_trc (GtkWidget *trc_widget, cairo_t *cr)
 	trc->priv->x_offset = 1;
 	trc->priv->y_offset = 1;
 
-	/* trc background */
-	gcm_trc_widget_draw_bounding_box (cr, 0, 0, trc->priv->chart_width, trc->priv->chart_height);
-	if (trc->priv->use_grid)
-		gcm_trc_widget_draw_grid (trc, cr);
-
-	gcm_trc_widget_draw_line (trc, cr);
+	if (allocation.width <= 1 || allocation.height <= 1)
+		goto out;
 
+	/* only drawn again when the data, size or profile changed */
+	gcm_trc_widget_ensure_surface (trc, gtk_widget_get_scale_factor (trc_widget));
+	cairo_set_source_surface (cr, trc->priv->surface, 0, 0);
+	cairo_paint (cr);
+out:
 	cairo_restore (cr);
 }
 
@@ -33,3 +33,16 @@ struct GcmTrcWidgetClass
 
 GType		 gcm_trc_widget_get_type		(void);
 GtkWidget	*gcm_trc_widget_new			(void);
+void		 gcm_trc_widget_get_range		(GcmTrcWidget		*trc,
+							 guint			 channel,
+							 guint			 start,
+							 guint			 end,
+							 gboolean		 exact,
+							 gfloat			*min,
+							 gfloat			*max);
+void		 gcm_trc_widget_get_column_range	(GcmTrcWidget		*trc,
+							 guint			 channel,
+							 guint			 column,
+							 guint			 columns,
+							 gfloat			*min,
+							 gfloat			*max);
@@ -12,9 +12,30 @@
 #include <gdk/gdkx.h>
 #include <colord.h>
 #include <math.h>
+#include <lcms2.h>
 
 #include "gcm-utils.h"
 
+/* the memory layout of CAIRO_FORMAT_RGB24 and CAIRO_FORMAT_ARGB32 */
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define GCM_UTILS_CAIRO_FORMAT		TYPE_BGRA_8
+#else
+#define GCM_UTILS_CAIRO_FORMAT		TYPE_ARGB_8
+#endif
+
+#define GCM_UTILS_RESPONSE_SUBDIVIDE	16	/* most samples between two columns */
+#define GCM_UTILS_RESPONSE_ERROR	1e-4f	/* good enough to interpolate */
+#define GCM_UTILS_TRANSFORM_CACHE_MAX	8	/* transforms kept ready */
+
+typedef struct {
+	gchar			*key;
+	CdTransform		*transform;
+} GcmUtilsTransformItem;
+
+/* most recently used first, only used from the main thread */
+static GQueue gcm_utils_transforms = G_QUEUE_INIT;
+static guint gcm_utils_transform_hits = 0;
+
 gchar *
 gcm_utils_linkify (const gchar *hostile_text)
 {
@@ -99,6 +120,153 @@ out:
 	return format;
 }
 
+/**
+ * gcm_utils_get_vcgt:
+ * @icc: a #CdIcc
+ * @error: a #GError or %NULL
+ *
+ * Gets the video card gamma table in the layout of the GcmTrcWidget
+ * "data-flat" property, with as many entries as the table in the profile
+ * so that nothing is lost to resampling.
+ *
+ * Return value: the red, then green, then blue samples, or %NULL
+ **/
+GBytes *
+gcm_utils_get_vcgt (CdIcc *icc, GError **error)
+{
+	cmsHPROFILE profile;
+	const cmsToneCurve **vcgt;
+	const cmsUInt16Number *table;
+	gfloat *samples;
+	guint c;
+	guint i;
+	guint n = 0;
+
+	profile = cd_icc_get_handle (icc);
+	if (profile == NULL) {
+		g_set_error_literal (error, 1, 0, "no profile loaded");
+		return NULL;
+	}
+	vcgt = cmsReadTag (profile, cmsSigVcgtTag);
+	if (vcgt == NULL || vcgt[0] == NULL || vcgt[1] == NULL || vcgt[2] == NULL) {
+		g_set_error_literal (error, 1, 0, "profile has no VCGT");
+		return NULL;
+	}
+
+	/* the channels are usually the same size, but use the biggest */
+	for (c = 0; c < 3; c++)
+		n = MAX (n, cmsGetToneCurveEstimatedTableEntries (vcgt[c]));
+	if (n < 2) {
+		g_set_error (error, 1, 0, "VCGT has %u entries", n);
+		return NULL;
+	}
+	samples = g_new (gfloat, n * 3);
+	for (c = 0; c < 3; c++) {
+		if (cmsGetToneCurveEstimatedTableEntries (vcgt[c]) == n) {
+			table = cmsGetToneCurveEstimatedTable (vcgt[c]);
+			for (i = 0; i < n; i++)
+				samples[c * n + i] = table[i] / 65535.0f;
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			samples[c * n + i] = cmsEvalToneCurveFloat (vcgt[c],
+								    (gfloat) i / (n - 1));
+		}
+	}
+	return g_bytes_new_take (samples, n * 3 * sizeof (gfloat));
+}
+
+static void
+gcm_utils_transform_item_free (GcmUtilsTransformItem *item)
+{
+	g_free (item->key);
+	g_object_unref (item->transform);
+	g_free (item);
+}
+
+static gboolean
+gcm_utils_append_checksum (GString *key, CdIcc *icc)
+{
+	const gchar *checksum;
+
+	/* the default for the transform */
+	if (icc == NULL) {
+		g_string_append (key, "-:");
+		return TRUE;
+	}
+	checksum = cd_icc_get_checksum (icc);
+	if (checksum == NULL)
+		return FALSE;
+	g_string_append_printf (key, "%s:", checksum);
+	return TRUE;
+}
+
+static CdTransform *
+gcm_utils_get_transform (CdIcc *input,
+			 CdIcc *abstract,
+			 CdIcc *output,
+			 CdRenderingIntent intent,
+			 CdPixelFormat pixel_format)
+{
+	CdTransform *transform;
+	GcmUtilsTransformItem *item;
+	GList *l;
+	g_autoptr(GString) key = g_string_new (NULL);
+
+	/* a profile we cannot identify is never shared */
+	if (gcm_utils_append_checksum (key, input) &&
+	    gcm_utils_append_checksum (key, abstract) &&
+	    gcm_utils_append_checksum (key, output)) {
+		g_string_append_printf (key, "%u:%u", intent, pixel_format);
+		for (l = gcm_utils_transforms.head; l != NULL; l = l->next) {
+			item = l->data;
+			if (g_strcmp0 (item->key, key->str) != 0)
+				continue;
+
+			/* the lcms transform inside is still valid */
+			gcm_utils_transform_hits++;
+			g_queue_unlink (&gcm_utils_transforms, l);
+			g_queue_push_head_link (&gcm_utils_transforms, l);
+			return g_object_ref (item->transform);
+		}
+	} else {
+		g_string_truncate (key, 0);
+	}
+
+	transform = cd_transform_new ();
+	cd_transform_set_input_icc (transform, input);
+	cd_transform_set_abstract_icc (transform, abstract);
+	cd_transform_set_output_icc (transform, output);
+	cd_transform_set_rendering_intent (transform, intent);
+	cd_transform_set_input_pixel_format (transform, pixel_format);
+	cd_transform_set_output_pixel_format (transform, pixel_format);
+	if (key->len == 0)
+		return transform;
+
+	/* drop the least recently used */
+	item = g_new0 (GcmUtilsTransformItem, 1);
+	item->key = g_strdup (key->str);
+	item->transform = g_object_ref (transform);
+	g_queue_push_head (&gcm_utils_transforms, item);
+	if (g_queue_get_length (&gcm_utils_transforms) > GCM_UTILS_TRANSFORM_CACHE_MAX)
+		gcm_utils_transform_item_free (g_queue_pop_tail (&gcm_utils_transforms));
+	return transform;
+}
+
+/**
+ * gcm_utils_get_transform_cache_hits:
+ *
+ * Gets how many times gcm_utils_image_convert() reused a transform rather
+ * than creating a new one, for the self tests.
+ *
+ * Return value: the number of cache hits since startup
+ **/
+guint
+gcm_utils_get_transform_cache_hits (void)
+{
+	return gcm_utils_transform_hits;
+}
+
 gboolean
 gcm_utils_image_convert (GtkImage *image,
 			 CdIcc *input,
@@ -147,14 +315,10 @@ gcm_utils_image_convert (GtkImage *image,
 					(GDestroyNotify) g_object_unref);
 	}
 
-	/* convert in-place */
-	transform = cd_transform_new ();
-	cd_transform_set_input_icc (transform, input);
-	cd_transform_set_abstract_icc (transform, abstract);
-	cd_transform_set_output_icc (transform, output);
-	cd_transform_set_rendering_intent (transform, CD_RENDERING_INTENT_PERCEPTUAL);
-	cd_transform_set_input_pixel_format (transform, pixel_format);
-	cd_transform_set_output_pixel_format (transform, pixel_format);
+	/* convert in-place, reusing the transform if we have seen these before */
+	transform = gcm_utils_get_transform (input, abstract, output,
+					     CD_RENDERING_INTENT_PERCEPTUAL,
+					     pixel_format);
 	bpp = gdk_pixbuf_get_rowstride (pixbuf) / gdk_pixbuf_get_width (pixbuf);
 	ret = cd_transform_process (transform,
 				    gdk_pixbuf_get_pixels (original_pixbuf),
@@ -173,3 +337,156 @@ gcm_utils_image_convert (GtkImage *image,
 	g_object_unref (pixbuf);
 	return TRUE;
 }
+
+/**
+ * gcm_utils_create_display_transform:
+ * @source: the profile of what was drawn
+ * @display: the display profile
+ *
+ * Creates a transform for the pixels of a cairo image surface, which can
+ * be kept for as long as neither profile changes.
+ *
+ * Return value: a transform, or %NULL if the display profile is not usable
+ **/
+cmsHTRANSFORM
+gcm_utils_create_display_transform (cmsHPROFILE source, CdIcc *display)
+{
+	cmsHPROFILE profile;
+
+	profile = cd_icc_get_handle (display);
+	if (profile == NULL)
+		return NULL;
+	return cmsCreateTransform (source, GCM_UTILS_CAIRO_FORMAT,
+				   profile, GCM_UTILS_CAIRO_FORMAT,
+				   INTENT_RELATIVE_COLORIMETRIC,
+				   cmsFLAGS_COPY_ALPHA);
+}
+
+/**
+ * gcm_utils_transform_surface:
+ * @transform: a transform from gcm_utils_create_display_transform()
+ * @surface: a cairo image surface
+ *
+ * Converts the whole surface in place using one call into lcms, rather
+ * than one for each pixel or row.
+ **/
+void
+gcm_utils_transform_surface (cmsHTRANSFORM transform, cairo_surface_t *surface)
+{
+	guchar *data;
+	gint stride;
+
+	cairo_surface_flush (surface);
+	data = cairo_image_surface_get_data (surface);
+	stride = cairo_image_surface_get_stride (surface);
+	cmsDoTransformLineStride (transform, data, data,
+				  cairo_image_surface_get_width (surface),
+				  cairo_image_surface_get_height (surface),
+				  stride, stride, 0, 0);
+	cairo_surface_mark_dirty (surface);
+}
+
+static void
+gcm_utils_sample_tone_curve (const cmsToneCurve *curve, gfloat *samples,
+			     guint n, guint start, guint end)
+{
+	gfloat lerp;
+	guint i;
+	guint mid;
+
+	/* the ends are already done */
+	if (end - start < 2)
+		return;
+	mid = (start + end) / 2;
+	samples[mid] = cmsEvalToneCurveFloat (curve, (gfloat) mid / (n - 1));
+	lerp = (samples[start] + samples[end]) / 2.0f;
+	if (fabs (samples[mid] - lerp) > GCM_UTILS_RESPONSE_ERROR) {
+		gcm_utils_sample_tone_curve (curve, samples, n, start, mid);
+		gcm_utils_sample_tone_curve (curve, samples, n, mid, end);
+		return;
+	}
+
+	/* straight enough that the rest need not be evaluated */
+	for (i = start + 1; i < end; i++) {
+		if (i == mid)
+			continue;
+		samples[i] = samples[start] + (samples[end] - samples[start]) *
+			     (gfloat) (i - start) / (end - start);
+	}
+}
+
+static GBytes *
+gcm_utils_get_response_for_transform (CdIcc *icc, guint size, GError **error)
+{
+	CdColorRGB *rgb;
+	gfloat *samples;
+	guint i;
+	g_autoptr(GPtrArray) array = NULL;
+
+	array = cd_icc_get_response (icc, size, error);
+	if (array == NULL)
+		return NULL;
+	samples = g_new (gfloat, array->len * 3);
+	for (i = 0; i < array->len; i++) {
+		rgb = g_ptr_array_index (array, i);
+		samples[i] = rgb->R;
+		samples[array->len + i] = rgb->G;
+		samples[array->len * 2 + i] = rgb->B;
+	}
+	return g_bytes_new_take (samples, array->len * 3 * sizeof (gfloat));
+}
+
+/**
+ * gcm_utils_get_response:
+ * @icc: a #CdIcc
+ * @size: the number of columns the curves are shown in
+ * @error: a #GError or %NULL
+ *
+ * Gets the response of each channel in the layout of the GcmTrcWidget
+ * "data-flat" property. For matrix/TRC profiles the curves are evaluated
+ * directly from the tags, more densely where they bend, and only profiles
+ * with a LUT are pushed through a transform.
+ *
+ * Return value: the red, then green, then blue samples, or %NULL
+ **/
+GBytes *
+gcm_utils_get_response (CdIcc *icc, guint size, GError **error)
+{
+	cmsHPROFILE profile;
+	const cmsTagSignature tags[] = { cmsSigRedTRCTag,
+					 cmsSigGreenTRCTag,
+					 cmsSigBlueTRCTag };
+	const cmsToneCurve *curve;
+	gfloat *samples;
+	guint c;
+	guint i;
+	guint n;
+
+	size = MAX (size, 2);
+	profile = cd_icc_get_handle (icc);
+	if (profile == NULL ||
+	    cmsGetColorSpace (profile) != cmsSigRgbData ||
+	    !cmsIsMatrixShaper (profile) ||
+	    cmsIsTag (profile, cmsSigAToB0Tag))
+		return gcm_utils_get_response_for_transform (icc, size, error);
+
+	/* every column is exact, and in between only where it bends */
+	n = (size - 1) * GCM_UTILS_RESPONSE_SUBDIVIDE + 1;
+	samples = g_new (gfloat, n * 3);
+	for (c = 0; c < 3; c++) {
+		curve = cmsReadTag (profile, tags[c]);
+		if (curve == NULL) {
+			g_free (samples);
+			return gcm_utils_get_response_for_transform (icc, size, error);
+		}
+		for (i = 0; i < n; i += GCM_UTILS_RESPONSE_SUBDIVIDE) {
+			samples[c * n + i] = cmsEvalToneCurveFloat (curve,
+								    (gfloat) i / (n - 1));
+		}
+		for (i = 0; i + 1 < n; i += GCM_UTILS_RESPONSE_SUBDIVIDE) {
+			gcm_utils_sample_tone_curve (curve, samples + c * n, n,
+						     i, i + GCM_UTILS_RESPONSE_SUBDIVIDE);
+		}
+	}
+	return g_bytes_new_take (samples, n * 3 * sizeof (gfloat));
+}
@@ -9,6 +9,8 @@
 
 #include <glib-object.h>
 #include <gtk/gtk.h>
+#include <colord.h>
+#include <lcms2.h>
 
 #define GCM_STOCK_ICON					"gnome-color-manager"
 #define GCM_DBUS_SERVICE				"org.gnome.ColorManager"
@@ -28,4 +30,13 @@ gboolean	 gcm_utils_image_convert		(GtkImage		*image,
 							 CdIcc			*abstract,
 							 CdIcc			*output,
 							 GError			**error);
-
+cmsHTRANSFORM	 gcm_utils_create_display_transform	(cmsHPROFILE		 source,
+							 CdIcc			*display);
+void		 gcm_utils_transform_surface		(cmsHTRANSFORM		 transform,
+							 cairo_surface_t	*surface);
+GBytes		*gcm_utils_get_response			(CdIcc			*icc,
+							 guint			 size,
+							 GError			**error);
+GBytes		*gcm_utils_get_vcgt			(CdIcc			*icc,
+							 GError			**error);
+guint		 gcm_utils_get_transform_cache_hits	(void);
@@ -75,6 +75,7 @@ enum {
 #define GCM_VIEWER_APPLICATION_ID		"org.gnome.ColorProfileViewer"
 #define GCM_VIEWER_TREEVIEW_WIDTH		350 /* px */
 #define GCM_VIEWER_MAX_EXAMPLE_IMAGES		4
+#define GCM_VIEWER_CURVE_COLUMNS		4096 /* the widest the TRC is shown, any scale */
 
 static void
 gcm_viewer_error_dialog (GcmViewerPrivate *viewer, const gchar *title, const gchar *message)
@@ -862,8 +863,8 @@ gcm_viewer_set_profile (GcmViewerPrivate *viewer, CdProfile *profile)
 	g_autofree gchar *size_text = NULL;
 	g_autoptr(CdIcc) icc = NULL;
 	g_autoptr(GError) error = NULL;
-	g_autoptr(GPtrArray) clut_trc = NULL;
-	g_autoptr(GPtrArray) clut_vcgt = NULL;
+	g_autoptr(GBytes) clut_trc = NULL;
+	g_autoptr(GBytes) clut_vcgt = NULL;
 
 	/* connect to the profile */
 	ret = cd_profile_connect_sync (profile, NULL, &error);
@@ -913,10 +914,10 @@ gcm_viewer_set_profile (GcmViewerPrivate *viewer, CdProfile *profile)
 
 	/* get curve data */
 	widget = GTK_WIDGET (gtk_builder_get_object (viewer->builder, "vbox_trc"));
-	clut_trc = cd_icc_get_response (icc, 256, NULL);
+	clut_trc = gcm_utils_get_response (icc, GCM_VIEWER_CURVE_COLUMNS, NULL);
 	if (clut_trc != NULL) {
 		g_object_set (viewer->trc_widget,
-			      "data", clut_trc,
+			      "data-flat", clut_trc,
 			      NULL);
 		gtk_widget_show (widget);
 	} else {
@@ -925,10 +926,10 @@ gcm_viewer_set_profile (GcmViewerPrivate *viewer, CdProfile *profile)
 
 	/* get vcgt data */
 	widget = GTK_WIDGET (gtk_builder_get_object (viewer->builder, "vbox_vcgt"));
-	clut_vcgt = cd_icc_get_vcgt (icc, 256, NULL);
+	clut_vcgt = gcm_utils_get_vcgt (icc, NULL);
 	if (clut_vcgt != NULL) {
 		g_object_set (viewer->vcgt_widget,
-			      "data", clut_vcgt,
+			      "data-flat", clut_vcgt,
 			      NULL);
 		gtk_widget_show (widget);
 	} else {
@@ -1456,6 +1457,7 @@ gcm_viewer_activate_cb (GApplication *application, GcmViewerPrivate *viewer)
 
 	/* use cie widget */
 	viewer->cie_widget = gcm_cie_widget_new ();
+	g_object_set (viewer->cie_widget, "async", TRUE, "use-planckian", TRUE, NULL);
 	widget = GTK_WIDGET (gtk_builder_get_object (viewer->builder, "vbox_cie_widget"));
 	gtk_box_pack_start (GTK_BOX(widget), viewer->cie_widget, TRUE, TRUE, 0);
 	gtk_box_reorder_child (GTK_BOX(widget), viewer->cie_widget, 0);